@@ -49,7 +49,7 @@
 ; Configuration Configuration
 ; ------------------------------------------------------------------------------
 KERNEL_START_SECTOR     equ 64
-KERNEL_MAX_SECTORS      equ 256         ; Support up to 128KB kernel
+KERNEL_MAX_SECTORS      equ 1024        ; Support up to 512KB kernel (temp copy ends at 0x90000, below the EBDA)
 KERNEL_SECTORS_PER_READ equ 64          ; Read 64 sectors (32KB) per operation
 KERNEL_TEMP_ADDR        equ 0x10000     ; Temporary load address (64KB)
 KERNEL_TEMP_SEGMENT     equ 0x1000      ; Segment for temp address (KERNEL_TEMP_ADDR >> 4)
@@ -0,0 +1,685 @@
+/*
+ * bench.c - In-Kernel Microbenchmarks
+ *
+ * BSD 3-Clause License
+ * Copyright (c) 2025, NeXs Operate System
+ */
+
+#include "bench.h"
+#include "buddy.h"
+#include "paging.h"
+#include "process.h"
+#include "vmm.h"
+#include "ipc.h"
+#include "messages.h"
+#include "chan.h"
+#include "topic.h"
+#include "csum.h"
+#include "sblock.h"
+#include "sync.h"
+#include "timer.h"
+#include "libc.h"
+#include "vga.h"
+
+struct bench {
+    const char* name;
+    const char* desc;
+    void (*run)(void);
+};
+
+// Print "  <label>: <cycles> cycles (<ns> ns)"
+static void bench_report(const char* label, uint64_t cycles) {
+    uint64_t freq = timer_get_freq();
+    vga_puts("  ");
+    vga_puts(label);
+    vga_puts(": ");
+    vga_puti((int)cycles);
+    vga_puts(" cycles");
+    if (freq) {
+        vga_puts(" (");
+        vga_puti((int)(cycles * NS_PER_SEC / freq));
+        vga_puts(" ns)");
+    }
+    vga_putc('\n');
+}
+
+// Print "  <label>: <x.yy> GB/s"
+static void bench_report_rate(const char* label, uint64_t bytes, uint64_t cycles) {
+    uint64_t freq = timer_get_freq();
+    uint64_t centi = cycles ? bytes * (freq / 10000000) / cycles : 0;   // GB/s * 100
+    vga_puts("  ");
+    vga_puts(label);
+    vga_puts(": ");
+    vga_puti((int)(centi / 100));
+    vga_putc('.');
+    if (centi % 100 < 10) vga_putc('0');
+    vga_puti((int)(centi % 100));
+    vga_puts(" GB/s\n");
+}
+
+// =============================================================================
+// Address-Space Switch (PCID vs. full TLB flush)
+// =============================================================================
+#define CTXSW_PAGES     64              // Working set touched after each switch
+#define CTXSW_ORDER     6               // 2^6 pages backing the working set
+#define CTXSW_ITERS     2000
+#define CTXSW_BASE      0x400000ULL     // User-half address mapped in both spaces
+
+static void ctxsw_touch(void) {
+    for (int i = 0; i < CTXSW_PAGES; i++) {
+        (void)*(volatile uint64_t*)(CTXSW_BASE + i * PAGE_SIZE);
+    }
+}
+
+// Average cycles per switch+touch, alternating between two CR3 values
+static uint64_t ctxsw_measure(uint64_t cr3_a, uint64_t cr3_b) {
+    // Warm up (also clears the stale mark of freshly allocated PCIDs)
+    paging_switch(cr3_a); ctxsw_touch();
+    paging_switch(cr3_b); ctxsw_touch();
+
+    uint64_t start = rdtsc();
+    for (int i = 0; i < CTXSW_ITERS; i++) {
+        paging_switch(cr3_a);
+        ctxsw_touch();
+        paging_switch(cr3_b);
+        ctxsw_touch();
+    }
+    return (rdtsc() - start) / (CTXSW_ITERS * 2);
+}
+
+static void bench_ctxsw(void) {
+    uint64_t* a = paging_create_space();
+    uint64_t* b = paging_create_space();
+    void* frames = page_alloc(CTXSW_ORDER);
+    if (!a || !b || !frames) {
+        vga_puts("  Out of memory\n");
+        goto out;
+    }
+
+    uint64_t phys = virt_to_phys(frames);
+    if (paging_map(a, CTXSW_BASE, phys, CTXSW_PAGES * PAGE_SIZE, PAGE_KERNEL_RW) != 0 ||
+        paging_map(b, CTXSW_BASE, phys, CTXSW_PAGES * PAGE_SIZE, PAGE_KERNEL_RW) != 0) {
+        vga_puts("  Mapping failed\n");
+        goto out;
+    }
+
+    vga_puts("  "); vga_puti(CTXSW_PAGES); vga_puts(" pages touched per switch, ");
+    vga_puti(CTXSW_ITERS * 2); vga_puts(" switches\n");
+
+    cli();
+    // PCID 0 (no tag): every CR3 load flushes the working set
+    uint64_t flush = ctxsw_measure(virt_to_phys(a), virt_to_phys(b));
+    uint64_t tagged = 0;
+    if (paging_pcid_enabled()) {
+        tagged = ctxsw_measure(paging_space_cr3(a), paging_space_cr3(b));
+    }
+
+    // Drop the untagged entries left in PCID 0, then resume the caller's space
+    write_cr3(virt_to_phys(kernel_pml4));
+    if (current_task) paging_switch(current_task->cr3);
+    sti();
+
+    bench_report("Without PCID", flush);
+    if (paging_pcid_enabled()) bench_report("With PCID   ", tagged);
+    else vga_puts("  With PCID:    not supported by CPU\n");
+
+out:
+    if (frames) page_free(frames, CTXSW_ORDER);
+    if (b) paging_destroy_space(b);
+    if (a) paging_destroy_space(a);
+}
+
+// =============================================================================
+// Task Cloning (copy-on-write vs. eager copy of initialized state)
+// =============================================================================
+#define CLONE_ORDER     8                   // 1MB of worker state
+#define CLONE_PAGES     (1 << CLONE_ORDER)
+
+static void clone_exit(void) {
+    exit();
+}
+
+// True if every page of [base, +CLONE_PAGES) is mapped and ours alone
+static bool clone_private(struct task* t, uint64_t base) {
+    for (int i = 0; i < CLONE_PAGES; i++) {
+        uint64_t phys, flags;
+        if (!paging_translate(task_space(t), base + i * PAGE_SIZE, &phys, &flags)) return false;
+        if (page_ref_count(phys_to_virt(phys)) != 1) return false;
+    }
+    return true;
+}
+
+static void bench_clone(void) {
+    struct task* self = current_task;
+    if (!self) return;
+
+    uint64_t base = vmm_map_anon(self, CLONE_PAGES * PAGE_SIZE, PAGE_KERNEL_RW | PAGE_NX);
+    void* copy = page_alloc(CLONE_ORDER);
+    uint64_t* pml4 = paging_create_space();
+    if (!base || !copy || !pml4) {
+        vga_puts("  Out of memory\n");
+        goto out;
+    }
+
+    // Parent initializes its state (demand faults every page in)
+    for (int i = 0; i < CLONE_PAGES; i++) {
+        *(volatile uint64_t*)(base + i * PAGE_SIZE) = i;
+    }
+
+    // Scratch child: never scheduled, only its address space is used
+    struct task child;
+    memset(&child, 0, sizeof(child));
+    child.cr3 = paging_space_cr3(pml4);
+
+    cli();
+    uint64_t start = rdtsc();
+    memcpy(copy, (void*)base, CLONE_PAGES * PAGE_SIZE);
+    uint64_t eager = rdtsc() - start;
+
+    start = rdtsc();
+    int rc = vmm_clone(self, &child);
+    uint64_t cloned = rdtsc() - start;
+
+    // Parent writes every page again: one COW break each
+    start = rdtsc();
+    for (int i = 0; i < CLONE_PAGES; i++) {
+        *(volatile uint64_t*)(base + i * PAGE_SIZE) = 0;
+    }
+    uint64_t broken = (rdtsc() - start) / CLONE_PAGES;
+    sti();
+
+    if (rc != 0) {
+        vga_puts("  Clone failed\n");
+    } else {
+        vga_puts("  "); vga_puti(CLONE_PAGES); vga_puts(" pages of initialized state\n");
+        bench_report("Eager copy      ", eager);
+        bench_report("COW clone       ", cloned);
+        bench_report("COW break / page", broken);
+    }
+    vmm_destroy(&child);
+
+    // A real clone that exits at once must drop its references when reaped
+    if (rc == 0) {
+        struct task* c = task_clone(clone_exit, self->priority);
+        if (!c) {
+            vga_puts("  Task clone failed\n");
+        } else {
+            uint32_t pid = c->pid;
+            while (task_find(pid)) {
+                sleep(1);
+                task_reap();
+            }
+            vga_puts(clone_private(self, base) ? "  Exited clone released its pages\n"
+                                               : "  Exited clone still holds page references\n");
+        }
+    }
+
+out:
+    if (pml4) paging_destroy_space(pml4);
+    if (copy) page_free(copy, CLONE_ORDER);
+    if (base) vmm_unmap(self, base);
+}
+
+// =============================================================================
+// IPC Round Trip (ipc_call/ipc_reply_wait vs. message queue)
+// =============================================================================
+#define IPC_ITERS       10000
+#define IPC_QUIT        0xFFFFFFFFFFFFFFFFULL   // Tells an echo server to exit
+
+// Echo w[0] + 1 back to the caller
+static void ipc_echo_server(void) {
+    struct ipc_msg m = { { 0 } };
+    int caller = 0;
+    for (;;) {
+        caller = ipc_reply_wait((uint32_t)caller, &m);
+        if (caller < 0) { caller = 0; continue; }
+        if (m.w[0] == IPC_QUIT) exit();     // Fails the pending call
+        m.w[0]++;
+    }
+}
+
+static uint8_t msg_buf_srv[sizeof(struct message) + 16] __attribute__((aligned(8)));
+static uint8_t msg_buf_cli[sizeof(struct message) + 16] __attribute__((aligned(8)));
+
+static void msg_echo_server(void) {
+    struct message* m = (struct message*)msg_buf_srv;
+    uint32_t self = current_task->pid;
+    for (;;) {
+        if (msg_receive_timeout(self, m, 8, 0) != 0) continue;
+        uint64_t v = *(uint64_t*)m->data;
+        if (v == IPC_QUIT) exit();
+        v++;
+        msg_send(self, m->sender_id, MSG_TYPE_RESPONSE, &v, sizeof(v));
+    }
+}
+
+static void bench_ipc(void) {
+    struct task* self = current_task;
+    if (!self) return;
+
+    struct task* srv = task_create_full(ipc_echo_server, self->priority, UID_KERNEL);
+    if (!srv) { vga_puts("  Out of memory\n"); return; }
+
+    struct ipc_msg m = { { 0 } };
+    ipc_call(srv->pid, &m);             // Warm up, server now waiting
+
+    uint64_t start = rdtsc();
+    for (int i = 0; i < IPC_ITERS; i++) {
+        m.w[0] = i;
+        ipc_call(srv->pid, &m);
+    }
+    uint64_t call = (rdtsc() - start) / IPC_ITERS;
+    bool ok = (m.w[0] == IPC_ITERS);
+
+    m.w[0] = IPC_QUIT;
+    ipc_call(srv->pid, &m);
+
+    // Same exchange through msg_send/msg_receive
+    uint64_t queue = 0;
+    srv = task_create_full(msg_echo_server, self->priority, UID_KERNEL);
+    if (srv) {
+        struct message* r = (struct message*)msg_buf_cli;
+        uint64_t v = 0;
+        msg_send(self->pid, srv->pid, MSG_TYPE_REQUEST, &v, sizeof(v));
+        msg_receive_timeout(self->pid, r, 8, 0);
+
+        start = rdtsc();
+        for (int i = 0; i < IPC_ITERS; i++) {
+            v = i;
+            msg_send(self->pid, srv->pid, MSG_TYPE_REQUEST, &v, sizeof(v));
+            msg_receive_timeout(self->pid, r, 8, 0);
+        }
+        queue = (rdtsc() - start) / IPC_ITERS;
+
+        v = IPC_QUIT;
+        msg_send(self->pid, srv->pid, MSG_TYPE_REQUEST, &v, sizeof(v));
+    }
+
+    vga_puts("  "); vga_puti(IPC_ITERS); vga_puts(" round trips");
+    vga_puts(ok ? "\n" : " (echo mismatch!)\n");
+    bench_report("ipc_call     ", call);
+    if (queue) bench_report("Message queue", queue);
+}
+
+// =============================================================================
+// Bulk Stream (shared-memory channel vs. message queue)
+// =============================================================================
+#define STREAM_BYTES    (16 * 1024 * 1024)
+#define STREAM_CHUNK    MSG_MAX_SIZE
+
+static volatile int stream_chan = -1;
+static volatile bool stream_done;
+static uint8_t stream_src[STREAM_CHUNK];
+static uint8_t stream_dst[sizeof(struct message) + STREAM_CHUNK] __attribute__((aligned(8)));
+
+static void chan_sink(void) {
+    while (stream_chan < 0) yield();
+    int id = stream_chan;
+    while (chan_read(id, stream_dst, STREAM_CHUNK, 0) > 0) {}
+    chan_close(id);
+    stream_done = true;
+    exit();
+}
+
+static void msg_sink(void) {
+    struct message* m = (struct message*)stream_dst;
+    uint32_t self = current_task->pid;
+    uint64_t got = 0;
+    while (got < STREAM_BYTES) {
+        if (msg_receive(self, m) == 0) got += m->size;
+    }
+    stream_done = true;
+    exit();
+}
+
+static void bench_stream(void) {
+    struct task* self = current_task;
+    if (!self) return;
+    memset(stream_src, 0x5A, sizeof(stream_src));
+
+    // Channel: one copy into the shared ring, one out
+    stream_chan = -1;
+    stream_done = false;
+    struct task* sink = task_create_full(chan_sink, self->priority, UID_KERNEL);
+    int id = sink ? chan_create(sink->pid, CHAN_DEFAULT_SIZE) : -1;
+    if (id < 0) { vga_puts("  Out of memory\n"); return; }
+
+    uint64_t start = rdtsc();
+    stream_chan = id;
+    for (uint64_t sent = 0; sent < STREAM_BYTES; sent += STREAM_CHUNK) {
+        chan_write(id, stream_src, STREAM_CHUNK);
+    }
+    chan_close(id);
+    while (!stream_done) yield();
+    uint64_t chan_cycles = rdtsc() - start;
+
+    // Message queue: copy into the ring slots, copy out, one message per chunk
+    stream_done = false;
+    sink = task_create_full(msg_sink, self->priority, UID_KERNEL);
+    uint64_t msg_cycles = 0;
+    if (sink) {
+        start = rdtsc();
+        for (uint64_t sent = 0; sent < STREAM_BYTES; sent += STREAM_CHUNK) {
+            while (msg_send(self->pid, sink->pid, MSG_TYPE_DATA, stream_src, STREAM_CHUNK) != 0) {
+                yield();    // Ring full
+            }
+        }
+        while (!stream_done) yield();
+        msg_cycles = rdtsc() - start;
+    }
+
+    vga_puts("  "); vga_puti(STREAM_BYTES >> 20); vga_puts("MB in ");
+    vga_puti(STREAM_CHUNK); vga_puts(" byte writes\n");
+    bench_report_rate("Channel (64KB ring)", STREAM_BYTES, chan_cycles);
+    if (msg_cycles) bench_report_rate("msg_send           ", STREAM_BYTES, msg_cycles);
+}
+
+// =============================================================================
+// Topic Fan-Out (filters and slow-subscriber policies)
+// =============================================================================
+#define TOPIC_MSGS      1000
+
+// One subscriber task per row, each configured from the table by index
+struct topic_case {
+    const char* label;
+    uint32_t types;
+    bool     even_only;     // Filter callback: even payloads only
+    uint32_t policy;
+    bool     reads;         // False: never reads (evicted), or exits at once
+};
+
+static const struct topic_case topic_cases[] = {
+    { "All, drop     ", TOPIC_TYPES_ALL,         false, TOPIC_POLICY_DROP,  true  },
+    { "DATA mask     ", 1U << MSG_TYPE_DATA,     false, TOPIC_POLICY_DROP,  true  },
+    { "Even filter   ", TOPIC_TYPES_ALL,         true,  TOPIC_POLICY_DROP,  true  },
+    { "Block         ", TOPIC_TYPES_ALL,         false, TOPIC_POLICY_BLOCK, true  },
+    { "Never reads   ", TOPIC_TYPES_ALL,         false, TOPIC_POLICY_EVICT, false },
+    { "Exits (block) ", TOPIC_TYPES_ALL,         false, TOPIC_POLICY_BLOCK, false },
+};
+
+#define TOPIC_CASES (sizeof(topic_cases) / sizeof(topic_cases[0]))
+
+static int topic_id;
+static volatile uint32_t topic_next, topic_ready, topic_exited;
+static volatile bool topic_published;
+static uint32_t topic_got[TOPIC_CASES];
+static bool topic_bad[TOPIC_CASES];
+
+static bool topic_even(const struct message* msg, void* ctx) {
+    (void)ctx;
+    return (*(const uint64_t*)msg->data & 1) == 0;
+}
+
+static void topic_subscriber(void) {
+    uint32_t i = __atomic_fetch_add(&topic_next, 1, __ATOMIC_RELAXED);
+    const struct topic_case* c = &topic_cases[i];
+    topic_subscribe(topic_id, c->types, c->even_only ? topic_even : NULL, NULL, c->policy);
+    __atomic_add_fetch(&topic_ready, 1, __ATOMIC_RELEASE);
+
+    if (c->policy == TOPIC_POLICY_BLOCK && !c->reads) goto out;  // Publisher must not wait on us
+    if (!c->reads) {
+        while (!topic_published) sleep(1);
+    }
+    for (;;) {
+        const struct message* m = topic_receive(topic_id, 10);
+        if (!m) {
+            if (topic_published || !c->reads) break;   // Drained, or evicted
+            continue;
+        }
+        uint64_t v = *(const uint64_t*)m->data;
+        if ((c->types != TOPIC_TYPES_ALL && !(c->types & (1U << m->type))) ||
+            (c->even_only && (v & 1))) {
+            topic_bad[i] = true;
+        }
+        topic_got[i]++;
+        topic_release(m);
+    }
+out:
+    __atomic_add_fetch(&topic_exited, 1, __ATOMIC_RELEASE);
+    exit();
+}
+
+static void bench_topic(void) {
+    struct task* self = current_task;
+    if (!self) return;
+
+    topic_id = topic_create("bench");
+    if (topic_id < 0) { vga_puts("  No free topic\n"); return; }
+    topic_next = topic_ready = topic_exited = 0;
+    topic_published = false;
+    memset(topic_got, 0, sizeof(topic_got));
+    memset(topic_bad, 0, sizeof(topic_bad));
+
+    uint32_t spawned = 0;
+    for (size_t i = 0; i < TOPIC_CASES; i++) {
+        if (task_create_full(topic_subscriber, self->priority, UID_KERNEL)) spawned++;
+    }
+    if (spawned < TOPIC_CASES) {
+        vga_puts("  Out of memory\n");
+        while (topic_exited < spawned) {
+            topic_published = true;
+            yield();
+        }
+        return;
+    }
+    while (topic_ready < TOPIC_CASES) yield();
+
+    // Alternate DATA and SIGNAL; the values alternate even and odd
+    uint64_t start = rdtsc();
+    for (uint64_t v = 0; v < TOPIC_MSGS; v++) {
+        topic_publish(topic_id, (v & 1) ? MSG_TYPE_SIGNAL : MSG_TYPE_DATA, &v, sizeof(v));
+    }
+    uint64_t cycles = (rdtsc() - start) / TOPIC_MSGS;
+    topic_published = true;
+    while (topic_exited < TOPIC_CASES) yield();
+
+    vga_puts("  "); vga_puti(TOPIC_MSGS); vga_puts(" messages, ");
+    vga_puti((int)TOPIC_CASES); vga_puts(" subscribers\n");
+    bench_report("Publish + fan-out", cycles);
+    for (size_t i = 0; i < TOPIC_CASES; i++) {
+        vga_puts("  ");
+        vga_puts(topic_cases[i].label);
+        vga_puts(": ");
+        vga_puti((int)topic_got[i]);
+        vga_puts(" received");
+        if (topic_bad[i]) vga_puts(" (FILTER MISMATCH)");
+        if (topic_cases[i].policy == TOPIC_POLICY_BLOCK && topic_cases[i].reads &&
+            topic_got[i] != TOPIC_MSGS) {
+            vga_puts(" (LOST MESSAGES)");
+        }
+        vga_putc('\n');
+    }
+}
+
+// =============================================================================
+// Checksums (sblock signing)
+// =============================================================================
+#define CSUM_ORDER      8                   // 1MB, the largest sblock
+#define CSUM_BYTES      (PAGE_SIZE << CSUM_ORDER)
+#define CSUM_ITERS      16
+
+typedef uint32_t (*crc_fn)(uint32_t crc, const void* data, size_t len);
+
+// What sblock.c used before csum.c: one bit per step, as the baseline
+static uint32_t crc32_bitwise(uint32_t crc, const void* data, size_t len) {
+    const uint8_t* p = data;
+    while (len--) {
+        crc ^= *p++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return crc;
+}
+
+static volatile uint32_t csum_sink;
+
+static uint64_t csum_measure(crc_fn fn, const void* buf, int iters) {
+    cli();
+    uint64_t start = rdtsc();
+    for (int i = 0; i < iters; i++) csum_sink = fn(0xFFFFFFFF, buf, CSUM_BYTES);
+    uint64_t cycles = rdtsc() - start;
+    sti();
+    return cycles;
+}
+
+static void bench_csum(void) {
+    uint8_t* buf = page_alloc(CSUM_ORDER);
+    struct sblock* blk = sblock_alloc(CSUM_BYTES, UID_KERNEL, SBLOCK_READ);
+    if (!buf || !blk) {
+        vga_puts("  Out of memory\n");
+        goto out;
+    }
+    for (uint32_t i = 0; i < CSUM_BYTES; i++) buf[i] = (uint8_t)(i * 31 + (i >> 9));
+    memcpy(blk->data, buf, CSUM_BYTES);
+
+    uint32_t hw = csum_features();
+    vga_puts("  "); vga_puti(CSUM_BYTES >> 10); vga_puts("KB buffer\n");
+    bench_report_rate("Bitwise (old)      ", CSUM_BYTES, csum_measure(crc32_bitwise, buf, 1));
+    bench_report_rate("CRC32 slice-by-8   ", (uint64_t)CSUM_BYTES * CSUM_ITERS,
+                      csum_measure(crc32_slice8, buf, CSUM_ITERS));
+    if (hw & CSUM_HW_PCLMUL) {
+        bench_report_rate("CRC32 PCLMUL       ", (uint64_t)CSUM_BYTES * CSUM_ITERS,
+                          csum_measure(crc32_pclmul, buf, CSUM_ITERS));
+    } else {
+        vga_puts("  CRC32 PCLMUL: not supported by CPU\n");
+    }
+    bench_report_rate("CRC32C slice-by-8  ", (uint64_t)CSUM_BYTES * CSUM_ITERS,
+                      csum_measure(crc32c_slice8, buf, CSUM_ITERS));
+    if (hw & CSUM_HW_SSE42) {
+        bench_report_rate("CRC32C SSE4.2      ", (uint64_t)CSUM_BYTES * CSUM_ITERS,
+                          csum_measure(crc32c_sse42, buf, CSUM_ITERS));
+    } else {
+        vga_puts("  CRC32C SSE4.2: not supported by CPU\n");
+    }
+
+    // End to end, with the algorithm picked at boot
+    uint64_t start = rdtsc();
+    for (int i = 0; i < CSUM_ITERS; i++) sblock_sign(blk);
+    uint64_t sign = rdtsc() - start;
+    start = rdtsc();
+    bool ok = true;
+    for (int i = 0; i < CSUM_ITERS; i++) ok &= sblock_verify(blk);
+    uint64_t verify = rdtsc() - start;
+
+    vga_puts("  sblock: "); vga_puts(csum_name(blk->csum_alg));
+    vga_puts(ok ? "\n" : " (VERIFY FAILED)\n");
+    bench_report_rate("sblock_sign        ", (uint64_t)CSUM_BYTES * CSUM_ITERS, sign);
+    bench_report_rate("sblock_verify      ", (uint64_t)CSUM_BYTES * CSUM_ITERS, verify);
+
+    // Read-mostly access: verified once, then served from the cache
+    struct sblock* ro = blk;
+    start = rdtsc();
+    for (int i = 0; i < CSUM_ITERS; i++) {
+        ok &= sblock_access(&ro, UID_KERNEL, SBLOCK_READ | SBLOCK_VERIFY) != NULL;
+    }
+    bench_report("Verified read access ", (rdtsc() - start) / CSUM_ITERS);
+
+    // Same bytes in page segments: must give the same signature
+    struct sblock* sg = sblock_alloc_sg(CSUM_BYTES, UID_KERNEL, SBLOCK_READ);
+    if (sg && sblock_copy_in(&sg, UID_KERNEL, 0, buf, CSUM_BYTES) == 0) {
+        start = rdtsc();
+        for (int i = 0; i < CSUM_ITERS; i++) {
+            sblock_mark_dirty(sg, 0, CSUM_BYTES);
+            sblock_sign(sg);
+        }
+        uint64_t sg_sign = rdtsc() - start;
+        if (sg->signature != blk->signature) vga_puts("  (SG SIGNATURE MISMATCH)\n");
+        bench_report_rate("sblock_sign (SG)   ", (uint64_t)CSUM_BYTES * CSUM_ITERS, sg_sign);
+    }
+    if (sg) sblock_free(sg);
+
+    // One byte changed: only its chunk and the tree path are rehashed
+    start = rdtsc();
+    for (int i = 0; i < CSUM_ITERS; i++) {
+        uint8_t* p = sblock_write(&blk, UID_KERNEL, (i * 65537) % CSUM_BYTES, 1);
+        if (p) (*p)++;
+        sblock_sign(blk);
+    }
+    bench_report("Re-sign, 1 byte dirty", (rdtsc() - start) / CSUM_ITERS);
+    start = rdtsc();
+    for (int i = 0; i < CSUM_ITERS; i++) ok &= sblock_verify_range(blk, (i * 65537) % CSUM_BYTES, 1);
+    bench_report("Verify 1 byte range  ", (rdtsc() - start) / CSUM_ITERS);
+    if (!ok) vga_puts("  (VERIFY FAILED)\n");
+
+out:
+    if (blk) sblock_free(blk);
+    if (buf) page_free(buf, CSUM_ORDER);
+}
+
+// =============================================================================
+// Locks (uncontended acquire + release)
+// =============================================================================
+#define LOCK_ITERS  100000
+
+static void bench_lock(void) {
+    static struct spinlock spin;
+    static struct mutex mtx;
+    static struct lock_stats spin_stats;
+    spin_init(&spin, NULL, NULL);
+    mutex_init(&mtx, NULL, NULL);
+
+    uint64_t start = rdtsc();
+    for (int i = 0; i < LOCK_ITERS; i++) irq_restore(irq_save());
+    bench_report("irq_save/restore      ", (rdtsc() - start) / LOCK_ITERS);
+
+    start = rdtsc();
+    for (int i = 0; i < LOCK_ITERS; i++) spin_unlock_irqrestore(&spin, spin_lock_irqsave(&spin));
+    bench_report("Spinlock, irqsave     ", (rdtsc() - start) / LOCK_ITERS);
+
+    // Same lock with statistics attached (two TSC reads per hold)
+    spin_init(&spin, &spin_stats, "bench");
+    start = rdtsc();
+    for (int i = 0; i < LOCK_ITERS; i++) spin_unlock_irqrestore(&spin, spin_lock_irqsave(&spin));
+    bench_report("Spinlock + stats      ", (rdtsc() - start) / LOCK_ITERS);
+
+    start = rdtsc();
+    for (int i = 0; i < LOCK_ITERS; i++) {
+        mutex_lock(&mtx);
+        mutex_unlock(&mtx);
+    }
+    bench_report("Mutex                 ", (rdtsc() - start) / LOCK_ITERS);
+}
+
+// =============================================================================
+// Registry
+// =============================================================================
+static const struct bench benches[] = {
+    { "ctxsw", "Address-space switch, with/without PCID", bench_ctxsw },
+    { "clone", "Copy-on-write clone vs. eager copy", bench_clone },
+    { "ipc",   "Call/reply round trip vs. message queue", bench_ipc },
+    { "stream", "Bulk throughput, shared channel vs. msg_send", bench_stream },
+    { "topic", "Pub/sub fan-out, filters and slow-subscriber policies", bench_topic },
+    { "csum",  "Checksum throughput, table vs. SSE4.2/PCLMUL", bench_csum },
+    { "lock",  "Uncontended spinlock and mutex vs. irq_save", bench_lock },
+};
+
+#define BENCH_COUNT (sizeof(benches) / sizeof(benches[0]))
+
+void bench_run(const char* name) {
+    if (name && *name) {
+        for (size_t i = 0; i < BENCH_COUNT; i++) {
+            if (strcmp(name, benches[i].name) == 0) {
+                vga_set_color(VGA_LIGHT_CYAN, VGA_BLACK);
+                vga_puts("Benchmark: ");
+                vga_puts(benches[i].desc);
+                vga_putc('\n');
+                vga_set_color(VGA_WHITE, VGA_BLACK);
+                benches[i].run();
+                return;
+            }
+        }
+        vga_puts("Unknown benchmark: ");
+        vga_puts(name);
+        vga_putc('\n');
+    }
+
+    vga_puts("Usage: bench <name>\n");
+    for (size_t i = 0; i < BENCH_COUNT; i++) {
+        vga_puts("  ");
+        vga_puts(benches[i].name);
+        vga_puts(" - ");
+        vga_puts(benches[i].desc);
+        vga_putc('\n');
+    }
+}
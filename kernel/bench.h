@@ -0,0 +1,19 @@
+/*
+ * bench.h - In-Kernel Microbenchmarks
+ *
+ * BSD 3-Clause License
+ * Copyright (c) 2025, NeXs Operate System
+ *
+ * TSC-timed loops run from the shell ("bench <name>").
+ * Interrupts are disabled while a measurement runs.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "kernel.h"
+
+// Run benchmark by name (NULL or "" lists available benchmarks)
+void bench_run(const char* name);
+
+#endif // BENCH_H
@@ -6,8 +6,10 @@
  */
 
 #include "buddy.h"
+#include "paging.h"
 #include "libc.h"
 #include "vga.h"
+#include "sync.h"
 
 // Block Metadata Header
 struct buddy_block {
@@ -19,6 +21,21 @@ struct buddy_block {
 
 #define BLOCK_MAGIC 0xB0DD1C0FFEULL
 
+// Page Frame Database (one entry per 4KB frame in the heap)
+// Block state lives here rather than in the block header, so page_alloc()
+// can hand out whole, header-less, page-aligned blocks.
+#define FRAME_FREE  0x01    // Head of a free block
+#define FRAME_USED  0x02    // Head of an allocated block
+
+struct page_frame {
+    uint8_t  order;         // Block level when this frame heads a block
+    uint8_t  flags;
+    uint16_t refcount;      // Mappings of a page_alloc() block (COW sharing)
+};
+
+static struct page_frame* frames;
+static size_t frame_count;
+
 // Free lists by level
 static struct buddy_block* free_lists[BUDDY_MAX_LEVELS];
 
@@ -32,6 +49,10 @@ static void* secure_start;
 static size_t secure_size;
 static size_t secure_used;
 
+// Free lists, frame database and the secure bump pointer
+static struct spinlock buddy_lock;
+static struct lock_stats buddy_lock_stats;
+
 // Global exports
 uint64_t g_total_memory = 0;
 uint64_t g_heap_base = 0;
@@ -53,6 +74,17 @@ static uint32_t size_to_level(size_t size) {
     return level;
 }
 
+static inline struct page_frame* block_frame(void* block) {
+    return &frames[((uint64_t)block - (uint64_t)heap_start) / BUDDY_MIN_SIZE];
+}
+
+// Frame of a heap page (NULL if ptr is outside the heap)
+static struct page_frame* frame_lookup(void* ptr) {
+    uint64_t addr = (uint64_t)ptr;
+    if (addr < (uint64_t)heap_start || addr >= (uint64_t)heap_start + heap_size) return NULL;
+    return block_frame((void*)(addr & ~(uint64_t)(BUDDY_MIN_SIZE - 1)));
+}
+
 static void* get_buddy(void* block, uint32_t level) {
     size_t block_size = level_to_size(level);
     uint64_t offset = (uint64_t)block - (uint64_t)heap_start;
@@ -60,30 +92,88 @@ static void* get_buddy(void* block, uint32_t level) {
     return (void*)((uint64_t)heap_start + buddy_offset);
 }
 
-static void split_block(struct buddy_block* block, uint32_t level) {
-    if (level == 0) return;
-    size_t half = level_to_size(level - 1);
+static void push_free(struct buddy_block* block, uint32_t level) {
+    block->level = level;
+    block->is_free = 1;
+    block->magic = BLOCK_MAGIC;
+    block->next = free_lists[level];
+    free_lists[level] = block;
+    
+    struct page_frame* f = block_frame(block);
+    f->order = level;
+    f->flags = FRAME_FREE;
+}
+
+static void remove_free(struct buddy_block* block, uint32_t level) {
+    struct buddy_block** pp = &free_lists[level];
+    while (*pp && *pp != block) {
+        pp = &(*pp)->next;
+    }
+    if (*pp) *pp = block->next;
+    block_frame(block)->flags = 0;
+}
+
+// Take a block of exactly `needed` level, splitting larger ones
+static struct buddy_block* take_block(uint32_t needed) {
+    uint32_t level = needed;
+    while (level < BUDDY_MAX_LEVELS && !free_lists[level]) {
+        level++;
+    }
+    if (level >= BUDDY_MAX_LEVELS) return NULL;
+    
+    struct buddy_block* block = free_lists[level];
+    free_lists[level] = block->next;
+    
+    // Split down, returning upper halves to the free lists
+    while (level > needed) {
+        level--;
+        push_free((struct buddy_block*)((uint64_t)block + level_to_size(level)), level);
+    }
     
-    struct buddy_block* buddy = (struct buddy_block*)((uint64_t)block + half);
-    buddy->level = level - 1;
-    buddy->is_free = 1;
-    buddy->magic = BLOCK_MAGIC;
+    struct page_frame* f = block_frame(block);
+    f->order = needed;
+    f->flags = FRAME_USED;
+    bytes_allocated += level_to_size(needed);
+    return block;
+}
+
+// Return a block to the free lists, coalescing with free buddies
+static void release_block(struct buddy_block* block, uint32_t level) {
+    bytes_allocated -= level_to_size(level);
+    block_frame(block)->flags = 0;
+    block_frame(block)->refcount = 0;
     
-    block->level = level - 1;
+    while (level < BUDDY_MAX_LEVELS - 1) {
+        struct buddy_block* buddy = get_buddy(block, level);
+        
+        if ((uint64_t)buddy < (uint64_t)heap_start ||
+            (uint64_t)buddy + level_to_size(level) > (uint64_t)heap_start + heap_size) {
+            break;
+        }
+        
+        struct page_frame* bf = block_frame(buddy);
+        if (!(bf->flags & FRAME_FREE) || bf->order != level) {
+            break;
+        }
+        
+        // Merge
+        remove_free(buddy, level);
+        if (buddy < block) block = buddy;
+        level++;
+    }
     
-    buddy->next = free_lists[level - 1];
-    free_lists[level - 1] = buddy;
-    block->next = free_lists[level - 1];
-    free_lists[level - 1] = block;
+    push_free(block, level);
 }
 
 // Initialize using E820 memory map
 void buddy_init_e820(struct e820_entry* entries, int count, uint64_t* out_secure_base) {
     vga_puts("DEBUG: buddy_init_e820\n");
     
-    // Find largest usable region above 1MB
+    // Find largest usable region above 1MB (within the kernel page map)
     uint64_t best_base = 0;
     uint64_t best_size = 0;
+    uint64_t mapped = 0;
+    paging_stats(&mapped, NULL, NULL);
     
     for (int i = 0; i < count; i++) {
         if (entries[i].type == E820_TYPE_USABLE) {
@@ -110,6 +200,9 @@ void buddy_init_e820(struct e820_entry* entries, int count, uint64_t* out_secure
                 }
             }
             
+            if (base >= mapped) continue;
+            if (base + len > mapped) len = mapped - base;
+            
             if (len > best_size) {
                 best_base = base;
                 best_size = len;
@@ -126,18 +219,18 @@ void buddy_init_e820(struct e820_entry* entries, int count, uint64_t* out_secure
     // Reserve top 64KB for secure storage
     if (best_size > SECURE_REGION_SIZE * 2) {
         secure_size = SECURE_REGION_SIZE;
-        secure_start = (void*)(best_base + best_size - secure_size);
+        secure_start = phys_to_virt(best_base + best_size - secure_size);
         secure_used = 0;
         best_size -= secure_size;
         
         if (out_secure_base) {
-            *out_secure_base = (uint64_t)secure_start;
+            *out_secure_base = best_base + best_size;
         }
-        g_secure_base = (uint64_t)secure_start;
+        g_secure_base = best_base + best_size;
     }
     
     // Initialize main heap
-    buddy_init((void*)best_base, best_size);
+    buddy_init(phys_to_virt(best_base), best_size);
     
     g_heap_base = best_base;
     g_heap_size = best_size;
@@ -145,60 +238,54 @@ void buddy_init_e820(struct e820_entry* entries, int count, uint64_t* out_secure
 
 void buddy_init(void* start, size_t size) {
     vga_puts("DEBUG: buddy_init start\n");
-    heap_start = start;
+    
+    // Page-align the region
+    uint64_t base = ((uint64_t)start + BUDDY_MIN_SIZE - 1) & ~(uint64_t)(BUDDY_MIN_SIZE - 1);
+    size -= base - (uint64_t)start;
+    size &= ~(size_t)(BUDDY_MIN_SIZE - 1);
+    
+    // Carve the frame database from the top of the region
+    size_t db_bytes = (size / BUDDY_MIN_SIZE) * sizeof(struct page_frame);
+    db_bytes = (db_bytes + BUDDY_MIN_SIZE - 1) & ~(size_t)(BUDDY_MIN_SIZE - 1);
+    size -= db_bytes;
+    frames = (struct page_frame*)(base + size);
+    frame_count = size / BUDDY_MIN_SIZE;
+    memset(frames, 0, frame_count * sizeof(struct page_frame));
+    
+    heap_start = (void*)base;
     heap_size = size;
     bytes_allocated = 0;
+    spin_init(&buddy_lock, &buddy_lock_stats, "buddy");
     
     for (int i = 0; i < BUDDY_MAX_LEVELS; i++) {
         free_lists[i] = NULL;
     }
     
-    // Find max level that fits
-    uint32_t max_level = 0;
-    size_t block_size = BUDDY_MIN_SIZE;
-    while ((block_size << 1) <= size && max_level < BUDDY_MAX_LEVELS - 1) {
-        block_size <<= 1;
-        max_level++;
+    // Cover the whole region with the largest naturally aligned blocks
+    size_t offset = 0;
+    while (offset + BUDDY_MIN_SIZE <= size) {
+        uint32_t level = BUDDY_MAX_LEVELS - 1;
+        while (level > 0 &&
+               ((offset & (level_to_size(level) - 1)) || offset + level_to_size(level) > size)) {
+            level--;
+        }
+        push_free((struct buddy_block*)(base + offset), level);
+        offset += level_to_size(level);
     }
-    
-    // Create initial block
-    struct buddy_block* initial = (struct buddy_block*)start;
-    initial->level = max_level;
-    initial->is_free = 1;
-    initial->magic = BLOCK_MAGIC;
-    initial->next = NULL;
-    
-    free_lists[max_level] = initial;
 }
 
 void* buddy_alloc(size_t size) {
     if (size == 0) return NULL;
     
     uint32_t needed = size_to_level(size);
-    
-    // Find smallest available block
-    uint32_t level = needed;
-    while (level < BUDDY_MAX_LEVELS && !free_lists[level]) {
-        level++;
-    }
-    
-    if (level >= BUDDY_MAX_LEVELS) return NULL;
-    
-    // Split if necessary
-    while (level > needed) {
-        struct buddy_block* block = free_lists[level];
-        free_lists[level] = block->next;
-        split_block(block, level);
-        level--;
-    }
-    
-    // Remove from free list
-    struct buddy_block* block = free_lists[needed];
+    uint64_t flags = spin_lock_irqsave(&buddy_lock);
+    struct buddy_block* block = take_block(needed);
+    spin_unlock_irqrestore(&buddy_lock, flags);
     if (!block) return NULL;
     
-    free_lists[needed] = block->next;
+    block->level = needed;
     block->is_free = 0;
-    bytes_allocated += level_to_size(needed);
+    block->magic = BLOCK_MAGIC;
     
     return (void*)((uint64_t)block + sizeof(struct buddy_block));
 }
@@ -208,41 +295,78 @@ void buddy_free(void* ptr) {
     
     struct buddy_block* block = (struct buddy_block*)((uint64_t)ptr - sizeof(struct buddy_block));
     
-    if (block->magic != BLOCK_MAGIC) {
+    uint64_t flags = spin_lock_irqsave(&buddy_lock);
+    if (block->magic != BLOCK_MAGIC || !(block_frame(block)->flags & FRAME_USED)) {
+        spin_unlock_irqrestore(&buddy_lock, flags);
         vga_puts("WARN: Invalid free\n");
         return;
     }
     
     block->is_free = 1;
-    bytes_allocated -= level_to_size(block->level);
+    release_block(block, block->level);
+    spin_unlock_irqrestore(&buddy_lock, flags);
+}
+
+void* page_alloc(uint32_t order) {
+    if (order >= BUDDY_MAX_LEVELS) return NULL;
+    uint64_t flags = spin_lock_irqsave(&buddy_lock);
+    struct buddy_block* block = take_block(order);
+    if (block) block_frame(block)->refcount = 1;
+    spin_unlock_irqrestore(&buddy_lock, flags);
+    return block;
+}
+
+void page_free(void* ptr, uint32_t order) {
+    if (!ptr) return;
     
-    // Try to coalesce with buddy
-    while (block->level < BUDDY_MAX_LEVELS - 1) {
-        struct buddy_block* buddy = get_buddy(block, block->level);
-        
-        if ((uint64_t)buddy < (uint64_t)heap_start ||
-            (uint64_t)buddy >= (uint64_t)heap_start + heap_size) {
-            break;
-        }
-        
-        if (!buddy->is_free || buddy->level != block->level) {
-            break;
-        }
-        
-        // Remove buddy from free list
-        struct buddy_block** pp = &free_lists[block->level];
-        while (*pp && *pp != buddy) {
-            pp = &(*pp)->next;
+    uint64_t addr = (uint64_t)ptr;
+    if (addr & (BUDDY_MIN_SIZE - 1) ||
+        addr < (uint64_t)heap_start || addr >= (uint64_t)heap_start + heap_size) {
+        vga_puts("WARN: Invalid page free\n");
+        return;
+    }
+    
+    uint64_t flags = spin_lock_irqsave(&buddy_lock);
+    struct page_frame* f = block_frame(ptr);
+    if (!(f->flags & FRAME_USED) || f->order != order) {
+        spin_unlock_irqrestore(&buddy_lock, flags);
+        vga_puts("WARN: Invalid page free\n");
+        return;
+    }
+    
+    release_block((struct buddy_block*)ptr, order);
+    spin_unlock_irqrestore(&buddy_lock, flags);
+}
+
+void page_ref_get(void* ptr) {
+    uint64_t flags = spin_lock_irqsave(&buddy_lock);
+    struct page_frame* f = frame_lookup(ptr);
+    if (f && (f->flags & FRAME_USED)) f->refcount++;
+    spin_unlock_irqrestore(&buddy_lock, flags);
+}
+
+uint32_t page_ref_put(void* ptr, uint32_t order) {
+    uint64_t flags = spin_lock_irqsave(&buddy_lock);
+    struct page_frame* f = frame_lookup(ptr);
+    uint32_t left = 0;
+    bool last = false;
+    if (f && (f->flags & FRAME_USED)) {
+        if (f->refcount > 1) {
+            left = --f->refcount;
+        } else {
+            last = true;
         }
-        if (*pp) *pp = buddy->next;
-        
-        // Merge
-        if (buddy < block) block = buddy;
-        block->level++;
     }
+    spin_unlock_irqrestore(&buddy_lock, flags);
     
-    block->next = free_lists[block->level];
-    free_lists[block->level] = block;
+    // Sole reference: nobody else can take one while we free it
+    if (last) page_free(ptr, order);
+    return left;
+}
+
+uint32_t page_ref_count(void* ptr) {
+    struct page_frame* f = frame_lookup(ptr);
+    return (f && (f->flags & FRAME_USED)) ? f->refcount : 0;
 }
 
 void buddy_stats(size_t* total, size_t* used, size_t* free) {
@@ -259,11 +383,14 @@ void secure_region_init(void* base, size_t size) {
 }
 
 void* secure_alloc(size_t size) {
+    uint64_t flags = spin_lock_irqsave(&buddy_lock);
     if (!secure_start || secure_used + size > secure_size) {
+        spin_unlock_irqrestore(&buddy_lock, flags);
         return NULL;
     }
     void* ptr = (void*)((uint64_t)secure_start + secure_used);
     secure_used += (size + 15) & ~15; // 16-byte align
+    spin_unlock_irqrestore(&buddy_lock, flags);
     return ptr;
 }
 
@@ -31,6 +31,16 @@ void* buddy_alloc(size_t size);
 // Free memory
 void buddy_free(void* ptr);
 
+// Page-aligned allocation of 2^order contiguous 4KB frames (no header)
+void* page_alloc(uint32_t order);
+void  page_free(void* ptr, uint32_t order);
+
+// Reference counts of page_alloc() blocks (start at 1).
+// page_ref_put() frees the block on the last reference, returns refs left.
+void     page_ref_get(void* ptr);
+uint32_t page_ref_put(void* ptr, uint32_t order);
+uint32_t page_ref_count(void* ptr);
+
 // Get statistics
 void buddy_stats(size_t* total, size_t* used, size_t* free);
 
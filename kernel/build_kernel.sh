@@ -45,6 +45,8 @@ KERNEL_NAME="x64kernel"
 BOOT_DISK="bootdisk.img"
 KERNEL_ELF="${KERNEL_NAME}.elf"
 KERNEL_BIN="${KERNEL_NAME}.bin"
+# Largest image stage2 loads (KERNEL_MAX_SECTORS sectors of 512 bytes)
+LOADER_MAX_SIZE=$(( $(awk '/^KERNEL_MAX_SECTORS/ {print $3}' ../boot/stage2.asm) * 512 ))
 
 # Build Mode (Default vs Optimized)
 # Default: -O2 (Standard)
@@ -71,7 +73,7 @@ ASFLAGS="-f elf64"
 LDFLAGS="-n -T kernel.ld -z max-page-size=0x1000 --no-warn-rwx-segments"
 
 # Source Files
-C_SOURCES="kernel.c libc.c buddy.c vga.c serial.c keyboard.c idt.c handlers.c timer.c messages.c permissions.c shell.c scheduler.c syscall.c module.c sblock.c"
+C_SOURCES="kernel.c libc.c buddy.c paging.c vga.c serial.c keyboard.c idt.c handlers.c timer.c messages.c permissions.c shell.c scheduler.c syscall.c module.c sblock.c vmm.c ipc.c chan.c port.c topic.c csum.c sync.c bench.c"
 ASM_SOURCES="kernel_entry.asm interrupts.asm"
 
 echo -e "${CYAN}=== x86_64 Kernel Build System [${BUILD_MODE}] ===${NC}"
@@ -135,6 +137,10 @@ echo -e "${YELLOW}Extracting binary...${NC}"
 objcopy -O binary $KERNEL_ELF $KERNEL_BIN
 KERNEL_SIZE=$(stat -c%s $KERNEL_BIN)
 echo "  Kernel size: $KERNEL_SIZE bytes"
+if [ "$KERNEL_SIZE" -gt "$LOADER_MAX_SIZE" ]; then
+    echo -e "${RED}[ERROR] Kernel exceeds the stage2 load limit ($LOADER_MAX_SIZE bytes, KERNEL_MAX_SECTORS in ../boot/stage2.asm)${NC}"
+    exit 1
+fi
 echo -e "${GREEN}[✓]${NC} Binary extraction complete"
 echo ""
 
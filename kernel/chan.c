@@ -0,0 +1,225 @@
+/*
+ * chan.c - Shared-Memory Channels
+ *
+ * BSD 3-Clause License
+ * Copyright (c) 2025, NeXs Operate System
+ */
+
+#include "chan.h"
+#include "process.h"
+#include "vmm.h"
+#include "buddy.h"
+#include "libc.h"
+#include "permissions.h"
+
+#define CHAN_PAGES_MAX  (CHAN_MAX_SIZE / PAGE_SIZE + 1)     // + header page
+
+// End indices
+#define CHAN_WRITER     0
+#define CHAN_READER     1
+
+struct chan {
+    bool     used;
+    uint32_t pid[2];            // Writer, reader
+    uint64_t va[2];             // Ring address in each space (0 once closed)
+    uint32_t pages;
+    void*    frames[CHAN_PAGES_MAX];
+    struct wait_queue rx;       // Reader parked on empty
+    struct wait_queue tx;       // Writer parked on full
+};
+
+static struct chan chans[CHAN_MAX];
+static struct chan_stats stats;
+
+static struct chan* chan_get(int id) {
+    if (id < 0 || id >= CHAN_MAX || !chans[id].used) return NULL;
+    return &chans[id];
+}
+
+// Which end the current task holds (-1 if none)
+static int chan_end(struct chan* c) {
+    if (!current_task) return -1;
+    for (int e = 0; e < 2; e++) {
+        if (c->va[e] && c->pid[e] == current_task->pid) return e;
+    }
+    return -1;
+}
+
+static void chan_free(struct chan* c) {
+    for (uint32_t i = 0; i < c->pages; i++) page_ref_put(c->frames[i], 0);
+    memset(c, 0, sizeof(*c));
+}
+
+int chan_create(uint32_t reader, size_t size) {
+    struct task* w = current_task;
+    struct task* r = task_find(reader);
+    if (!w || !r || r == w || !(w->perm_mask & PERM_MSG_SEND)) return -1;
+    if (size == 0 || size > CHAN_MAX_SIZE) return -1;
+
+    int id = 0;
+    while (id < CHAN_MAX && chans[id].used) id++;
+    if (id == CHAN_MAX) return -1;
+    struct chan* c = &chans[id];
+    memset(c, 0, sizeof(*c));
+    c->used = true;
+
+    // Power-of-two data pages so offsets wrap with a mask
+    uint32_t data = 1;
+    while (data * PAGE_SIZE < size) data <<= 1;
+    for (c->pages = 0; c->pages < data + 1; c->pages++) {
+        void* page = page_alloc(0);
+        if (!page) { chan_free(c); return -1; }
+        memset(page, 0, PAGE_SIZE);
+        c->frames[c->pages] = page;
+    }
+    ((struct chan_ring*)c->frames[0])->size = data * PAGE_SIZE;
+
+    c->pid[CHAN_WRITER] = w->pid;
+    c->pid[CHAN_READER] = r->pid;
+    c->va[CHAN_WRITER] = vmm_map_shared(w, c->frames, c->pages, PAGE_KERNEL_RW | PAGE_NX);
+    c->va[CHAN_READER] = vmm_map_shared(r, c->frames, c->pages, PAGE_KERNEL_RW | PAGE_NX);
+    if (!c->va[CHAN_WRITER] || !c->va[CHAN_READER]) {
+        if (c->va[CHAN_WRITER]) vmm_unmap(w, c->va[CHAN_WRITER]);
+        if (c->va[CHAN_READER]) vmm_unmap(r, c->va[CHAN_READER]);
+        chan_free(c);
+        return -1;
+    }
+    return id;
+}
+
+struct chan_ring* chan_ring(int id) {
+    struct chan* c = chan_get(id);
+    int e = c ? chan_end(c) : -1;
+    return e < 0 ? NULL : (struct chan_ring*)c->va[e];
+}
+
+// Ring the doorbell if the peer parked itself
+static void chan_doorbell(volatile uint32_t* waiting, struct wait_queue* wq) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!*waiting) return;
+    *waiting = 0;
+
+    uint64_t flags = irq_save();
+    struct task* woken = wake_one(wq);
+    irq_restore(flags);
+    if (!woken) return;
+
+    stats.doorbells++;
+    if (current_task && woken->priority < current_task->priority) yield();
+}
+
+// Park until ready() or the peer closes. Returns -2 on timeout.
+static int chan_park(struct chan* c, volatile uint32_t* waiting, struct wait_queue* wq,
+                     struct chan_ring* ring, bool reader, uint64_t timeout_ms) {
+    int rc = 0;
+    uint64_t flags = irq_save();
+    *waiting = 1;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    // Recheck after announcing ourselves: the peer may have just moved
+    uint32_t used = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - ring->tail;
+    bool blocked = reader ? used == 0 : used == ring->size;
+    bool peer_open = c->va[reader ? CHAN_WRITER : CHAN_READER] != 0;
+    if (blocked && peer_open) {
+        uint32_t state = reader ? TASK_WAITING_MSG : TASK_BLOCKED;
+        if (wait_queue_sleep(wq, state, timeout_ms) < 0) rc = -2;
+    }
+    *waiting = 0;
+    irq_restore(flags);
+    return rc;
+}
+
+ssize_t chan_write(int id, const void* buf, size_t n) {
+    struct chan* c = chan_get(id);
+    if (!c || chan_end(c) != CHAN_WRITER || (!buf && n)) return -1;
+
+    struct chan_ring* ring = (struct chan_ring*)c->va[CHAN_WRITER];
+    uint8_t* data = (uint8_t*)ring + PAGE_SIZE;
+    const uint8_t* src = buf;
+    size_t done = 0;
+
+    while (done < n) {
+        if (!c->va[CHAN_READER]) return -1;     // Reader gone
+
+        uint32_t head = ring->head;
+        uint32_t space = ring->size - (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE));
+        if (space == 0) {
+            chan_park(c, &ring->tx_waiting, &c->tx, ring, false, 0);
+            continue;
+        }
+
+        uint32_t len = (n - done < space) ? (uint32_t)(n - done) : space;
+        uint32_t off = head & (ring->size - 1);
+        uint32_t first = (off + len > ring->size) ? ring->size - off : len;
+        memcpy(data + off, src + done, first);
+        memcpy(data, src + done + first, len - first);
+
+        __atomic_store_n(&ring->head, head + len, __ATOMIC_RELEASE);
+        done += len;
+        stats.bytes += len;
+
+        chan_doorbell(&ring->rx_waiting, &c->rx);
+    }
+    return (ssize_t)done;
+}
+
+ssize_t chan_read(int id, void* buf, size_t n, uint64_t timeout_ms) {
+    struct chan* c = chan_get(id);
+    if (!c || chan_end(c) != CHAN_READER || (!buf && n)) return -1;
+
+    struct chan_ring* ring = (struct chan_ring*)c->va[CHAN_READER];
+    uint8_t* data = (uint8_t*)ring + PAGE_SIZE;
+
+    for (;;) {
+        uint32_t tail = ring->tail;
+        uint32_t used = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - tail;
+        if (used == 0) {
+            if (!c->va[CHAN_WRITER]) return 0;  // End of stream
+            if (chan_park(c, &ring->rx_waiting, &c->rx, ring, true, timeout_ms) < 0) return -2;
+            continue;
+        }
+
+        uint32_t len = (n < used) ? (uint32_t)n : used;
+        uint32_t off = tail & (ring->size - 1);
+        uint32_t first = (off + len > ring->size) ? ring->size - off : len;
+        memcpy(buf, data + off, first);
+        memcpy((uint8_t*)buf + first, data, len - first);
+
+        __atomic_store_n(&ring->tail, tail + len, __ATOMIC_RELEASE);
+        chan_doorbell(&ring->tx_waiting, &c->tx);
+        return (ssize_t)len;
+    }
+}
+
+// Drop end e, held by t
+static void chan_close_end(struct chan* c, int e, struct task* t) {
+    vmm_unmap(t, c->va[e]);
+    c->va[e] = 0;
+
+    // Peer sees end of stream / broken channel
+    wake_all(e == CHAN_WRITER ? &c->rx : &c->tx);
+
+    if (!c->va[CHAN_WRITER] && !c->va[CHAN_READER]) chan_free(c);
+}
+
+int chan_close(int id) {
+    struct chan* c = chan_get(id);
+    int e = c ? chan_end(c) : -1;
+    if (e < 0) return -1;
+
+    chan_close_end(c, e, current_task);
+    return 0;
+}
+
+void chan_task_exit(struct task* t) {
+    for (int id = 0; id < CHAN_MAX; id++) {
+        struct chan* c = &chans[id];
+        for (int e = 0; e < 2 && c->used; e++) {
+            if (c->va[e] && c->pid[e] == t->pid) chan_close_end(c, e, t);
+        }
+    }
+}
+
+void chan_get_stats(struct chan_stats* out) {
+    if (out) *out = stats;
+}
@@ -0,0 +1,65 @@
+/*
+ * chan.h - Shared-Memory Channels
+ *
+ * BSD 3-Clause License
+ * Copyright (c) 2025, NeXs Operate System
+ *
+ * One-way byte stream between two tasks through a ring buffer mapped
+ * into both address spaces (vmm_map_shared). Data is copied once, by
+ * the writer into the ring, and read out by the reader. The kernel is
+ * only entered through the doorbell: a parked reader is woken when the
+ * ring goes from empty to non-empty, a parked writer when a full ring
+ * gets space again.
+ */
+
+#ifndef CHAN_H
+#define CHAN_H
+
+#include "kernel.h"
+#include "paging.h"
+#include "process.h"
+
+#define CHAN_MAX            16
+#define CHAN_MAX_SIZE       0x80000     // 512KB of ring data
+#define CHAN_DEFAULT_SIZE   0x10000     // 64KB
+
+// Shared header page, ring data follows at +PAGE_SIZE.
+// Writer and reader fields sit on separate cache lines.
+struct chan_ring {
+    volatile uint32_t head;         // Bytes written (writer only)
+    volatile uint32_t tx_waiting;   // Writer parked on a full ring
+    uint8_t  pad0[56];
+    volatile uint32_t tail;         // Bytes read (reader only)
+    volatile uint32_t rx_waiting;   // Reader parked on an empty ring
+    uint8_t  pad1[56];
+    uint32_t size;                  // Data bytes (power of two)
+};
+
+struct chan_stats {
+    uint64_t bytes;
+    uint64_t doorbells;     // Wakeups actually delivered
+};
+
+// Create a channel from the current task (writer) to 'reader'.
+// size is rounded up to a power of two pages. Returns the id or -1.
+int chan_create(uint32_t reader, size_t size);
+
+// Ring mapping of the current task (NULL if not an endpoint)
+struct chan_ring* chan_ring(int id);
+
+// Write all n bytes, blocking while the ring is full. -1 if closed.
+ssize_t chan_write(int id, const void* buf, size_t n);
+
+// Read up to n bytes, blocking while empty (timeout_ms 0 = forever).
+// Returns bytes read, 0 at end of stream, -2 on timeout, -1 on error.
+ssize_t chan_read(int id, void* buf, size_t n, uint64_t timeout_ms);
+
+// Drop the current task's end; the ring is freed when both ends closed
+int chan_close(int id);
+
+// Task exit: close every end the task still holds, waking the peers
+void chan_task_exit(struct task* t);
+
+void chan_get_stats(struct chan_stats* out);
+
+#endif // CHAN_H
@@ -0,0 +1,271 @@
+/*
+ * csum.c - Checksum Engine
+ *
+ * BSD 3-Clause License
+ * Copyright (c) 2025, NeXs Operate System
+ */
+
+#include "csum.h"
+
+// Reflected polynomials
+#define POLY_CRC32      0xEDB88320
+#define POLY_CRC32C     0x82F63B78
+
+// XMM registers are not part of the task context: PCLMUL folding runs
+// with interrupts off, this many bytes at a time
+#define FOLD_CHUNK      0x10000
+#define FOLD_MIN        128     // Shorter buffers are faster with tables
+
+static uint32_t crc32_table[8][256];
+static uint32_t crc32c_table[8][256];
+static uint32_t features;
+
+static void table_build(uint32_t t[8][256], uint32_t poly) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c >> 1) ^ (poly & -(c & 1));
+        }
+        t[0][i] = c;
+    }
+    // t[k][i]: CRC of byte i followed by k zero bytes
+    for (int k = 1; k < 8; k++) {
+        for (int i = 0; i < 256; i++) {
+            t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+        }
+    }
+}
+
+void csum_init(void) {
+    table_build(crc32_table, POLY_CRC32);
+    table_build(crc32c_table, POLY_CRC32C);
+
+    uint32_t a, b, c, d;
+    cpuid(1, 0, &a, &b, &c, &d);
+    features = 0;
+    if (c & (1 << 20)) features |= CSUM_HW_SSE42;
+    if ((c & (1 << 1)) && (c & (1 << 19))) features |= CSUM_HW_PCLMUL;
+}
+
+uint32_t csum_features(void) {
+    return features;
+}
+
+uint8_t csum_default(void) {
+    return (features & CSUM_HW_SSE42) ? CSUM_CRC32C : CSUM_CRC32;
+}
+
+const char* csum_name(uint8_t alg) {
+    switch (alg) {
+        case CSUM_CRC32:  return (features & CSUM_HW_PCLMUL) ? "crc32 (pclmul)" : "crc32 (slice-by-8)";
+        case CSUM_CRC32C: return (features & CSUM_HW_SSE42) ? "crc32c (sse4.2)" : "crc32c (slice-by-8)";
+        default:          return "unknown";
+    }
+}
+
+// =============================================================================
+// Slice-by-8
+// =============================================================================
+static uint32_t slice8(uint32_t t[8][256], uint32_t crc, const uint8_t* p, size_t len) {
+    while (len && ((uint64_t)p & 7)) {
+        crc = t[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        len--;
+    }
+    for (; len >= 8; len -= 8, p += 8) {
+        uint64_t w = *(const uint64_t*)p ^ crc;
+        crc = t[7][w & 0xFF] ^ t[6][(w >> 8) & 0xFF] ^
+              t[5][(w >> 16) & 0xFF] ^ t[4][(w >> 24) & 0xFF] ^
+              t[3][(w >> 32) & 0xFF] ^ t[2][(w >> 40) & 0xFF] ^
+              t[1][(w >> 48) & 0xFF] ^ t[0][w >> 56];
+    }
+    while (len--) {
+        crc = t[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+uint32_t crc32_slice8(uint32_t crc, const void* data, size_t len) {
+    return slice8(crc32_table, crc, data, len);
+}
+
+uint32_t crc32c_slice8(uint32_t crc, const void* data, size_t len) {
+    return slice8(crc32c_table, crc, data, len);
+}
+
+// =============================================================================
+// SSE4.2 crc32 (CRC32C only: the instruction's polynomial is fixed)
+// =============================================================================
+uint32_t crc32c_sse42(uint32_t crc, const void* data, size_t len) {
+    const uint8_t* p = data;
+    while (len && ((uint64_t)p & 7)) {
+        asm("crc32b %1, %0" : "+r"(crc) : "rm"(*p));
+        p++;
+        len--;
+    }
+    uint64_t c = crc;
+    for (; len >= 8; len -= 8, p += 8) {
+        asm("crc32q %1, %0" : "+r"(c) : "rm"(*(const uint64_t*)p));
+    }
+    crc = (uint32_t)c;
+    while (len--) {
+        asm("crc32b %1, %0" : "+r"(crc) : "rm"(*p));
+        p++;
+    }
+    return crc;
+}
+
+// =============================================================================
+// PCLMULQDQ Folding (CRC32)
+// =============================================================================
+// Intel, "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ".
+// Four 128-bit lanes are folded 64 bytes ahead (R2:R1), merged into one
+// (R4:R3), reduced to 64 bits, then to 32 (R5) and finished with a
+// Barrett reduction (u' and P', bit reflected).
+static const uint64_t k_r2r1[2] __attribute__((aligned(16))) = { 0x154442bd4ULL, 0x1c6e41596ULL };
+static const uint64_t k_r4r3[2] __attribute__((aligned(16))) = { 0x1751997d0ULL, 0x0ccaa009eULL };
+static const uint64_t k_r5[2]   __attribute__((aligned(16))) = { 0x163cd6124ULL, 0 };
+static const uint64_t k_mask[2] __attribute__((aligned(16))) = { 0xFFFFFFFFULL, 0 };
+static const uint64_t k_poly[2] __attribute__((aligned(16))) = { 0x1DB710641ULL, 0x1F7011641ULL };
+
+// p 16-byte aligned, len >= 64 and a multiple of 16
+static uint32_t crc32_fold(uint32_t crc, const uint8_t* p, size_t len) {
+    uint32_t out;
+    asm volatile(
+        "movdqa (%[p]), %%xmm1\n\t"
+        "movdqa 0x10(%[p]), %%xmm2\n\t"
+        "movdqa 0x20(%[p]), %%xmm3\n\t"
+        "movdqa 0x30(%[p]), %%xmm4\n\t"
+        "movd %[crc], %%xmm0\n\t"
+        "pxor %%xmm0, %%xmm1\n\t"
+        "sub $0x40, %[len]\n\t"
+        "add $0x40, %[p]\n\t"
+        "cmp $0x40, %[len]\n\t"
+        "jb 2f\n\t"
+        "movdqa %[r2r1], %%xmm0\n"
+
+        // Fold 64 bytes per iteration
+        "1:\n\t"
+        "prefetchnta 0x40(%[p])\n\t"
+        "movdqa %%xmm1, %%xmm5\n\t"
+        "movdqa %%xmm2, %%xmm6\n\t"
+        "movdqa %%xmm3, %%xmm7\n\t"
+        "movdqa %%xmm4, %%xmm8\n\t"
+        "pclmulqdq $0x00, %%xmm0, %%xmm1\n\t"
+        "pclmulqdq $0x00, %%xmm0, %%xmm2\n\t"
+        "pclmulqdq $0x00, %%xmm0, %%xmm3\n\t"
+        "pclmulqdq $0x00, %%xmm0, %%xmm4\n\t"
+        "pclmulqdq $0x11, %%xmm0, %%xmm5\n\t"
+        "pclmulqdq $0x11, %%xmm0, %%xmm6\n\t"
+        "pclmulqdq $0x11, %%xmm0, %%xmm7\n\t"
+        "pclmulqdq $0x11, %%xmm0, %%xmm8\n\t"
+        "pxor %%xmm5, %%xmm1\n\t"
+        "pxor %%xmm6, %%xmm2\n\t"
+        "pxor %%xmm7, %%xmm3\n\t"
+        "pxor %%xmm8, %%xmm4\n\t"
+        "pxor (%[p]), %%xmm1\n\t"
+        "pxor 0x10(%[p]), %%xmm2\n\t"
+        "pxor 0x20(%[p]), %%xmm3\n\t"
+        "pxor 0x30(%[p]), %%xmm4\n\t"
+        "sub $0x40, %[len]\n\t"
+        "add $0x40, %[p]\n\t"
+        "cmp $0x40, %[len]\n\t"
+        "jae 1b\n"
+
+        // Four lanes into one
+        "2:\n\t"
+        "movdqa %[r4r3], %%xmm0\n\t"
+        "movdqa %%xmm1, %%xmm5\n\t"
+        "pclmulqdq $0x00, %%xmm0, %%xmm1\n\t"
+        "pclmulqdq $0x11, %%xmm0, %%xmm5\n\t"
+        "pxor %%xmm5, %%xmm1\n\t"
+        "pxor %%xmm2, %%xmm1\n\t"
+        "movdqa %%xmm1, %%xmm5\n\t"
+        "pclmulqdq $0x00, %%xmm0, %%xmm1\n\t"
+        "pclmulqdq $0x11, %%xmm0, %%xmm5\n\t"
+        "pxor %%xmm5, %%xmm1\n\t"
+        "pxor %%xmm3, %%xmm1\n\t"
+        "movdqa %%xmm1, %%xmm5\n\t"
+        "pclmulqdq $0x00, %%xmm0, %%xmm1\n\t"
+        "pclmulqdq $0x11, %%xmm0, %%xmm5\n\t"
+        "pxor %%xmm5, %%xmm1\n\t"
+        "pxor %%xmm4, %%xmm1\n\t"
+        "cmp $0x10, %[len]\n\t"
+        "jb 4f\n"
+
+        // Remaining 16-byte blocks
+        "3:\n\t"
+        "movdqa %%xmm1, %%xmm5\n\t"
+        "pclmulqdq $0x00, %%xmm0, %%xmm1\n\t"
+        "pclmulqdq $0x11, %%xmm0, %%xmm5\n\t"
+        "pxor %%xmm5, %%xmm1\n\t"
+        "pxor (%[p]), %%xmm1\n\t"
+        "sub $0x10, %[len]\n\t"
+        "add $0x10, %[p]\n\t"
+        "cmp $0x10, %[len]\n\t"
+        "jae 3b\n"
+
+        // 128 -> 64 bits (appending 32 zero bits), 64 -> 32, Barrett
+        "4:\n\t"
+        "pclmulqdq $0x01, %%xmm1, %%xmm0\n\t"
+        "psrldq $0x08, %%xmm1\n\t"
+        "pxor %%xmm0, %%xmm1\n\t"
+        "movdqa %%xmm1, %%xmm2\n\t"
+        "movdqa %[r5], %%xmm0\n\t"
+        "movdqa %[mask], %%xmm3\n\t"
+        "psrldq $0x04, %%xmm2\n\t"
+        "pand %%xmm3, %%xmm1\n\t"
+        "pclmulqdq $0x00, %%xmm0, %%xmm1\n\t"
+        "pxor %%xmm2, %%xmm1\n\t"
+        "movdqa %[poly], %%xmm0\n\t"
+        "movdqa %%xmm1, %%xmm2\n\t"
+        "pand %%xmm3, %%xmm1\n\t"
+        "pclmulqdq $0x10, %%xmm0, %%xmm1\n\t"
+        "pand %%xmm3, %%xmm1\n\t"
+        "pclmulqdq $0x00, %%xmm0, %%xmm1\n\t"
+        "pxor %%xmm2, %%xmm1\n\t"
+        "pextrd $0x01, %%xmm1, %[out]\n\t"
+        : [out] "=r"(out), [p] "+r"(p), [len] "+r"(len)
+        : [crc] "r"(crc), [r2r1] "m"(k_r2r1), [r4r3] "m"(k_r4r3),
+          [r5] "m"(k_r5), [mask] "m"(k_mask), [poly] "m"(k_poly)
+        : "cc", "memory");
+    return out;
+}
+
+uint32_t crc32_pclmul(uint32_t crc, const void* data, size_t len) {
+    const uint8_t* p = data;
+
+    // Tables up to 16-byte alignment
+    size_t head = (16 - ((uint64_t)p & 15)) & 15;
+    if (head > len) head = len;
+    crc = crc32_slice8(crc, p, head);
+    p += head;
+    len -= head;
+
+    while (len >= 64) {
+        size_t n = (len < FOLD_CHUNK ? len : FOLD_CHUNK) & ~(size_t)15;
+        uint64_t flags = irq_save();
+        crc = crc32_fold(crc, p, n);
+        irq_restore(flags);
+        p += n;
+        len -= n;
+    }
+    return crc32_slice8(crc, p, len);
+}
+
+// =============================================================================
+// Dispatch
+// =============================================================================
+uint32_t csum(uint8_t alg, const void* data, size_t len) {
+    switch (alg) {
+        case CSUM_CRC32:
+            if ((features & CSUM_HW_PCLMUL) && len >= FOLD_MIN) {
+                return ~crc32_pclmul(0xFFFFFFFF, data, len);
+            }
+            return ~crc32_slice8(0xFFFFFFFF, data, len);
+        case CSUM_CRC32C:
+            if (features & CSUM_HW_SSE42) return ~crc32c_sse42(0xFFFFFFFF, data, len);
+            return ~crc32c_slice8(0xFFFFFFFF, data, len);
+        default:
+            return 0;
+    }
+}
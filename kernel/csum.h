@@ -0,0 +1,50 @@
+/*
+ * csum.h - Checksum Engine (CRC32 / CRC32C)
+ *
+ * BSD 3-Clause License
+ * Copyright (c) 2025, NeXs Operate System
+ *
+ * Table-driven CRCs (slice-by-8, 8 bytes per step) with hardware paths
+ * picked at boot from CPUID:
+ * - SSE4.2 crc32 instruction for CRC32C
+ * - PCLMULQDQ folding for CRC32 (64 bytes per step)
+ * Every algorithm also has a table path, so a checksum recorded on one
+ * CPU verifies on any other.
+ */
+
+#ifndef CSUM_H
+#define CSUM_H
+
+#include "kernel.h"
+
+// Algorithms (stored in struct sblock, keep the values stable)
+#define CSUM_CRC32      0   // IEEE 802.3 polynomial (Ethernet, zlib)
+#define CSUM_CRC32C     1   // Castagnoli polynomial (iSCSI, ext4)
+#define CSUM_ALGS       2
+
+// CPU features found by csum_init()
+#define CSUM_HW_SSE42   0x01    // crc32 instruction
+#define CSUM_HW_PCLMUL  0x02    // Carry-less multiply (+ SSE4.1 pextrd)
+
+// Build the tables and probe the CPU
+void csum_init(void);
+
+uint32_t csum_features(void);
+
+// Fastest algorithm on this CPU (used for new signatures)
+uint8_t csum_default(void);
+
+const char* csum_name(uint8_t alg);
+
+// Checksum of a buffer (standard pre/post inversion). Unknown
+// algorithms return 0.
+uint32_t csum(uint8_t alg, const void* data, size_t len);
+
+// Individual engines, for benchmarks. They take and return the raw CRC
+// state (no inversion). The hardware ones need the matching feature.
+uint32_t crc32_slice8(uint32_t crc, const void* data, size_t len);
+uint32_t crc32_pclmul(uint32_t crc, const void* data, size_t len);
+uint32_t crc32c_slice8(uint32_t crc, const void* data, size_t len);
+uint32_t crc32c_sse42(uint32_t crc, const void* data, size_t len);
+
+#endif // CSUM_H
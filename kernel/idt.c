@@ -35,11 +35,19 @@
 #include "idt.h"
 #include "vga.h"
 #include "libc.h"
+#include "vmm.h"
 
 // IDT Table Storage (256 Entries)
 static struct idt_entry idt[256];
 static struct idt_ptr idtp;
 
+// TSS and IST Stacks
+static struct tss tss;
+static uint8_t ist_stacks[2][IST_STACK_SIZE] __attribute__((aligned(16)));
+
+// GDT (kernel_entry.asm), TSS descriptor at TSS_SELECTOR
+extern uint64_t gdt64[];
+
 // Architecture-specific External Assembly Stubs
 extern void isr0(void);
 extern void isr1(void);
@@ -188,6 +196,32 @@ void idt_set_gate(uint8_t num, uint64_t handler, uint16_t selector, uint8_t flag
     idt[num].zero = 0;
 }
 
+void idt_set_ist(uint8_t num, uint8_t ist) {
+    idt[num].ist = ist & 0x7;
+}
+
+/**
+ * Install TSS descriptor and load Task Register
+ */
+static void tss_init(void) {
+    memset(&tss, 0, sizeof(tss));
+    tss.ist[IST_PAGE_FAULT - 1] = (uint64_t)&ist_stacks[0][IST_STACK_SIZE];
+    tss.ist[IST_DOUBLE_FAULT - 1] = (uint64_t)&ist_stacks[1][IST_STACK_SIZE];
+    tss.iomap_base = sizeof(tss);   // No I/O permission bitmap
+
+    // 16-byte system descriptor: Type 0x9 (available 64-bit TSS), Present
+    uint64_t base = (uint64_t)&tss;
+    uint64_t limit = sizeof(tss) - 1;
+    gdt64[TSS_SELECTOR / 8] = (limit & 0xFFFF) |
+                              ((base & 0xFFFFFF) << 16) |
+                              (0x89ULL << 40) |
+                              (((limit >> 16) & 0xF) << 48) |
+                              (((base >> 24) & 0xFF) << 56);
+    gdt64[TSS_SELECTOR / 8 + 1] = base >> 32;
+
+    asm volatile("ltr %0" : : "r"((uint16_t)TSS_SELECTOR));
+}
+
 /**
  * Initialize IDT Subsystem
  */
@@ -238,6 +272,11 @@ void idt_init(void) {
     idt_set_gate(30, (uint64_t)isr30, 0x08, 0x8E);
     idt_set_gate(31, (uint64_t)isr31, 0x08, 0x8E);
     
+    // Page faults may come from an unmapped stack page: use IST stacks
+    tss_init();
+    idt_set_ist(8, IST_DOUBLE_FAULT);
+    idt_set_ist(14, IST_PAGE_FAULT);
+    
     // Install IRQ Handlers (32-47)
     idt_set_gate(32, (uint64_t)irq0, 0x08, 0x8E);
     idt_set_gate(33, (uint64_t)irq1, 0x08, 0x8E);
@@ -274,8 +313,18 @@ void isr_exception_handler(struct interrupt_frame* frame) {
     // Disable interrupts to prevent nested crashes
     cli();
     
+    // Demand paging: resolved faults return straight to the faulting code
+    uint64_t cr2;
+    asm volatile("mov %%cr2, %0" : "=r"(cr2));
+    if (frame->int_no == 14 && vmm_handle_fault(cr2, frame->err_code)) {
+        return;
+    }
+    
     vga_set_color(VGA_WHITE, VGA_RED);
     vga_puts("\n\n*** KERNEL EXCEPTION ***\n");
+    if (frame->int_no == 14 && vmm_stack_guard(cr2)) {
+        vga_puts("Stack overflow (guard page hit)\n");
+    }
     
     // Identify Exception
     if (frame->int_no < 32) {
@@ -290,8 +339,6 @@ void isr_exception_handler(struct interrupt_frame* frame) {
     vga_putx(frame->err_code);
     
     // Dump CR2 (Fault Address) if Page Fault
-    uint64_t cr2;
-    asm volatile("mov %%cr2, %0" : "=r"(cr2));
     vga_puts("  CR2: ");
     vga_putx(cr2);
     
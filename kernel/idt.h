@@ -54,6 +54,25 @@ struct idt_ptr {
     uint64_t base;
 } __attribute__((packed));
 
+// Task State Segment (64-bit): only the IST stacks are used (no ring 3 yet)
+struct tss {
+    uint32_t reserved0;
+    uint64_t rsp[3];        // Ring 0-2 stacks
+    uint64_t reserved1;
+    uint64_t ist[7];        // Interrupt Stack Table (IST1-IST7)
+    uint64_t reserved2;
+    uint16_t reserved3;
+    uint16_t iomap_base;
+} __attribute__((packed));
+
+// GDT Selector of the TSS (descriptor filled in by idt_init)
+#define TSS_SELECTOR        0x18
+
+// IST Stacks: faults that may hit an unmapped stack run on their own stack
+#define IST_PAGE_FAULT      1
+#define IST_DOUBLE_FAULT    2
+#define IST_STACK_SIZE      8192
+
 // CPU State Frame (Pushed by Interrupt Stub)
 struct interrupt_frame {
     uint64_t gs, fs, es, ds;
@@ -69,6 +88,9 @@ void idt_init(void);
 // Low-level Gateway setup
 void idt_set_gate(uint8_t num, uint64_t handler, uint16_t selector, uint8_t flags);
 
+// Run a gate on an IST stack (1-7)
+void idt_set_ist(uint8_t num, uint8_t ist);
+
 // Standard Exception Messages
 extern const char* exception_messages[32];
 
@@ -180,6 +180,7 @@ isr128:
     ; Registers are already set by caller, pass stack pointer
     mov rdi, rsp
     call syscall_handler
+    mov rsp, rax        ; Resume frame (another task after an IPC handoff)
     
     ; Restore segment registers
     pop rax
@@ -0,0 +1,187 @@
+/*
+ * ipc.c - Synchronous IPC (L4-style call/reply)
+ *
+ * BSD 3-Clause License
+ * Copyright (c) 2025, NeXs Operate System
+ */
+
+#include "ipc.h"
+#include "syscall.h"
+#include "permissions.h"
+
+static struct ipc_stats stats;
+
+// A task blocked in a syscall has its isr128 frame at the saved RSP
+static inline struct interrupt_frame* ipc_frame(struct task* t) {
+    return (struct interrupt_frame*)t->rsp;
+}
+
+static inline void ipc_copy(struct interrupt_frame* dst, const struct interrupt_frame* src) {
+    dst->rsi = src->rsi;
+    dst->rdx = src->rdx;
+    dst->r10 = src->r10;
+    dst->r8  = src->r8;
+}
+
+static uint64_t ipc_fail(struct interrupt_frame* frame) {
+    frame->rax = (uint64_t)-1;
+    return (uint64_t)frame;
+}
+
+// Resume a blocked caller with an error (callee gone)
+static void ipc_abort(struct task* t) {
+    ipc_frame(t)->rax = (uint64_t)-1;
+    t->ipc_state = IPC_IDLE;
+    t->ipc_partner = NULL;
+    t->state = TASK_READY;
+}
+
+// Block the current task until a partner resumes it. Whoever does writes
+// the result into rax; until then it reads as failure. scheduler_switch()
+// keeps running us if it cannot switch (scheduler busy, nothing else
+// ready): undo the block and fail the call, or a partner would later
+// write into a frame that is long gone.
+static uint64_t ipc_block(struct interrupt_frame* frame) {
+    struct task* me = current_task;
+    frame->rax = (uint64_t)-1;
+    
+    uint64_t rsp = scheduler_switch((uint64_t)frame);
+    if (rsp != (uint64_t)frame) return rsp;
+    
+    if (me->ipc_state == IPC_SENDING && me->ipc_partner) {
+        wait_queue_remove(&me->ipc_partner->ipc_callers, me);
+    }
+    me->ipc_state = IPC_IDLE;
+    me->ipc_partner = NULL;
+    me->state = TASK_RUNNING;
+    return rsp;
+}
+
+uint64_t ipc_sys_call(struct interrupt_frame* frame) {
+    struct task* me = current_task;
+    if (!me || !(me->perm_mask & PERM_MSG_SEND)) return ipc_fail(frame);
+    
+    struct task* dest = task_find((uint32_t)frame->rdi);
+    if (!dest || dest == me || dest->state == TASK_TERMINATED) return ipc_fail(frame);
+    
+    stats.calls++;
+    me->ipc_partner = dest;
+    me->state = TASK_BLOCKED;
+    frame->rax = (uint64_t)-1;      // Until the reply
+    
+    if (dest->ipc_state == IPC_RECEIVING) {
+        // Server is waiting: deliver into its frame and run it now
+        struct interrupt_frame* df = ipc_frame(dest);
+        ipc_copy(df, frame);
+        df->rdi = me->pid;
+        df->rax = 0;
+        dest->ipc_state = IPC_IDLE;
+        me->ipc_state = IPC_AWAIT_REPLY;
+        stats.handoffs++;
+        return scheduler_handoff((uint64_t)frame, dest);
+    }
+    
+    // Server busy: its next ipc_reply_wait() picks us up
+    me->ipc_state = IPC_SENDING;
+    wait_queue_add(&dest->ipc_callers, me);
+    stats.queued++;
+    return ipc_block(frame);
+}
+
+uint64_t ipc_sys_reply_wait(struct interrupt_frame* frame) {
+    struct task* me = current_task;
+    if (!me || !(me->perm_mask & PERM_MSG_RECEIVE)) return ipc_fail(frame);
+    
+    struct task* caller = NULL;
+    uint32_t reply_to = (uint32_t)frame->rdi;
+    if (reply_to) {
+        caller = task_find(reply_to);
+        if (!caller || caller->ipc_state != IPC_AWAIT_REPLY || caller->ipc_partner != me) {
+            return ipc_fail(frame);
+        }
+        struct interrupt_frame* cf = ipc_frame(caller);
+        ipc_copy(cf, frame);
+        cf->rax = 0;
+        caller->ipc_state = IPC_IDLE;
+        caller->ipc_partner = NULL;
+    }
+    
+    // Next caller already queued: take its request and keep running
+    struct task* next = wait_queue_pop(&me->ipc_callers);
+    if (next) {
+        ipc_copy(frame, ipc_frame(next));
+        frame->rdi = next->pid;
+        frame->rax = 0;
+        next->ipc_state = IPC_AWAIT_REPLY;
+        if (caller) caller->state = TASK_READY;
+        return (uint64_t)frame;
+    }
+    
+    me->ipc_state = IPC_RECEIVING;
+    me->state = TASK_BLOCKED;
+    if (caller) {
+        frame->rax = (uint64_t)-1;  // Until a caller arrives
+        stats.handoffs++;
+        return scheduler_handoff((uint64_t)frame, caller);
+    }
+    return ipc_block(frame);
+}
+
+void ipc_task_exit(struct task* t) {
+    uint64_t flags = irq_save();
+    
+    // Queued at someone else
+    if (t->ipc_state == IPC_SENDING && t->ipc_partner) {
+        wait_queue_remove(&t->ipc_partner->ipc_callers, t);
+    }
+    t->ipc_state = IPC_IDLE;
+    t->ipc_partner = NULL;
+    
+    // Callers queued at us, or waiting for our reply
+    struct task* c;
+    while ((c = wait_queue_pop(&t->ipc_callers)) != NULL) ipc_abort(c);
+    for (c = t->next; c != t; c = c->next) {
+        if (c->ipc_state == IPC_AWAIT_REPLY && c->ipc_partner == t) ipc_abort(c);
+    }
+    
+    irq_restore(flags);
+}
+
+void ipc_get_stats(struct ipc_stats* out) {
+    if (out) *out = stats;
+}
+
+/*
+ * Wrappers
+ */
+int ipc_call(uint32_t dest, struct ipc_msg* msg) {
+    uint64_t rax = SYS_IPC_CALL;
+    uint64_t rsi = msg->w[0], rdx = msg->w[1];
+    register uint64_t r10 asm("r10") = msg->w[2];
+    register uint64_t r8  asm("r8")  = msg->w[3];
+    
+    asm volatile("int $0x80"
+        : "+a"(rax), "+S"(rsi), "+d"(rdx), "+r"(r10), "+r"(r8)
+        : "D"((uint64_t)dest)
+        : "memory");
+    
+    msg->w[0] = rsi; msg->w[1] = rdx; msg->w[2] = r10; msg->w[3] = r8;
+    return (int)(int64_t)rax;
+}
+
+int ipc_reply_wait(uint32_t reply_to, struct ipc_msg* msg) {
+    uint64_t rax = SYS_IPC_REPLY_WAIT;
+    uint64_t rdi = reply_to;
+    uint64_t rsi = msg->w[0], rdx = msg->w[1];
+    register uint64_t r10 asm("r10") = msg->w[2];
+    register uint64_t r8  asm("r8")  = msg->w[3];
+    
+    asm volatile("int $0x80"
+        : "+a"(rax), "+D"(rdi), "+S"(rsi), "+d"(rdx), "+r"(r10), "+r"(r8)
+        :
+        : "memory");
+    
+    if ((int64_t)rax < 0) return -1;
+    msg->w[0] = rsi; msg->w[1] = rdx; msg->w[2] = r10; msg->w[3] = r8;
+    return (int)rdi;
+}
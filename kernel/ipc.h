@@ -0,0 +1,58 @@
+/*
+ * ipc.h - Synchronous IPC (L4-style call/reply)
+ *
+ * BSD 3-Clause License
+ * Copyright (c) 2025, NeXs Operate System
+ *
+ * Request/response without queues or copies through memory:
+ * - IPC_WORDS message words travel in registers (rsi, rdx, r10, r8)
+ * - ipc_call() to a waiting server switches straight to it
+ * - ipc_reply_wait() answers the last caller and waits for the next,
+ *   switching straight back to the caller when nobody else is queued
+ */
+
+#ifndef IPC_H
+#define IPC_H
+
+#include "kernel.h"
+#include "idt.h"
+#include "process.h"
+
+#define IPC_WORDS       4
+
+// Per-task IPC state (task->ipc_state)
+enum ipc_state {
+    IPC_IDLE,
+    IPC_RECEIVING,      // Blocked in ipc_reply_wait(), open for any caller
+    IPC_SENDING,        // Blocked in ipc_call(), queued at the callee
+    IPC_AWAIT_REPLY,    // Blocked in ipc_call(), callee is serving us
+};
+
+struct ipc_msg {
+    uint64_t w[IPC_WORDS];
+};
+
+struct ipc_stats {
+    uint64_t calls;
+    uint64_t handoffs;  // Calls/replies that switched directly to the peer
+    uint64_t queued;    // Calls that found the callee busy
+};
+
+// Call 'dest' and wait for its reply, which replaces *msg.
+// Returns 0, or -1 if dest does not exist or exits before replying.
+int ipc_call(uint32_t dest, struct ipc_msg* msg);
+
+// Reply *msg to reply_to (0 = none), then wait for the next call.
+// Returns the caller's PID with its request in *msg, or -1.
+int ipc_reply_wait(uint32_t reply_to, struct ipc_msg* msg);
+
+// Syscall side: return the RSP to resume (isr128 switches to it)
+uint64_t ipc_sys_call(struct interrupt_frame* frame);
+uint64_t ipc_sys_reply_wait(struct interrupt_frame* frame);
+
+// Fail every call blocked on an exiting task
+void ipc_task_exit(struct task* t);
+
+void ipc_get_stats(struct ipc_stats* out);
+
+#endif // IPC_H
@@ -37,6 +37,7 @@
 #include "serial.h"
 #include "libc.h"
 #include "buddy.h"
+#include "paging.h"
 #include "idt.h"
 #include "keyboard.h"
 #include "messages.h"
@@ -44,6 +45,8 @@
 #include "shell.h"
 #include "process.h"
 #include "syscall.h"
+#include "vmm.h"
+#include "csum.h"
 
 // External IRQ initialization (defined in handlers.c or interrupts.asm)
 void irq_init(void);
@@ -81,6 +84,9 @@ static void print_init(const char* component, bool success) {
  * This function is called from the assembly stub `_start` in kernel_entry.asm.
  */
 void kernel_main(struct boot_info* info) {
+    // Stage2 passes a physical pointer; reach it through the direct map
+    if (info) info = phys_to_virt((uint64_t)info);
+
     // 1. Initialize Serial Port FIRST for debug logging (Headless support)
     serial_init();
     
@@ -113,7 +119,7 @@ void kernel_main(struct boot_info* info) {
     print_banner();
     
     // DEBUG: Direct write to video memory (Green 'X' visualization check)
-    *((volatile uint16_t*)0xB8050) = 0x2F58; // 2F = White on Green, 58 = 'X'
+    *((volatile uint16_t*)(PHYS_MAP_BASE + 0xB8050)) = 0x2F58; // 2F = White on Green, 58 = 'X'
     
     vga_set_color(VGA_YELLOW, VGA_BLACK);
     vga_puts("Initializing kernel subsystems...\n\n");
@@ -143,6 +149,22 @@ void kernel_main(struct boot_info* info) {
     vga_puti(boot->total_memory_mb);
     vga_puts(" MB\n");
     
+    // Build kernel page tables covering all RAM (boot map stops at 16MB)
+    paging_init(e820_entries, boot->e820_count);
+    uint64_t mapped;
+    uint32_t pages_1g, pages_2m;
+    paging_stats(&mapped, &pages_1g, &pages_2m);
+    print_init("Paging (Kernel PML4)", true);
+    vga_puts("      Mapped: ");
+    vga_puti(mapped / (1024 * 1024));
+    vga_puts(" MB (1GB pages: ");
+    vga_puti(pages_1g);
+    vga_puts(", 2MB pages: ");
+    vga_puti(pages_2m);
+    vga_puts(")\n");
+    vga_puts("      PCID: ");
+    vga_puts(paging_pcid_enabled() ? "enabled (tagged TLB per task)\n" : "not supported\n");
+    
     // Initialize buddy with E820 (reserves secure region)
     uint64_t secure_base = 0;
     if (boot->e820_count > 0) {
@@ -150,8 +172,8 @@ void kernel_main(struct boot_info* info) {
     } else {
         // Fallback to static allocation
         extern uint64_t _kernel_end;
-        uint64_t heap_start_addr = ((uint64_t)&_kernel_end + 4095) & ~4095;
-        buddy_init((void*)heap_start_addr, 0x80000);
+        uint64_t heap_start_addr = (virt_to_phys(&_kernel_end) + 4095) & ~4095;
+        buddy_init(phys_to_virt(heap_start_addr), 0x80000);
     }
     
     print_init("Memory Allocator (Buddy)", true);
@@ -172,6 +194,9 @@ void kernel_main(struct boot_info* info) {
     keyboard_init();
     print_init("PS/2 Keyboard Driver", true);
     
+    csum_init();
+    print_init("Checksum Engine", true);
+    
     msg_init();
     print_init("IPC Message System", true);
     
@@ -214,15 +239,26 @@ void kernel_main(struct boot_info* info) {
         vga_puti(shell_task->pid);
         vga_puts(") Priority: HIGH\n");
     }
+    
+    // Background huge page collapser
+    struct task* thp_task = task_create_priority(vmm_collapse_daemon, PRIORITY_LOW);
+    if (thp_task) {
+        thp_task->flags |= TASK_FLAG_DAEMON;
+        vga_puts("      THP Collapser (PID ");
+        vga_puti(thp_task->pid);
+        vga_puts(") Priority: LOW\n");
+    }
     print_init("Multitasking System", true);
 
     vga_puts("Enabling Interrupts...\n");
     sti();
     
     // The Kernel Main (Task 0) becomes the Idle task
-    // Priority IDLE, runs only when no other task is READY
+    // Priority IDLE, runs only when no other task is READY, and frees
+    // tasks that have exited
     vga_puts("Ready.\n\n");
     while(1) {
+        task_reap();
         hlt();
     }
 }
@@ -65,7 +65,10 @@ struct boot_info {
 #define MAX_MESSAGES        256
 
 // Memory Layout
-#define KERNEL_LOAD_ADDR    0x100000    // 1MB
+#define KERNEL_LOAD_ADDR    0x100000    // 1MB (physical)
+#define KERNEL_VMA_BASE     0xFFFFFFFF80000000ULL   // Kernel image (upper 2GB)
+#define PHYS_MAP_BASE       0xFFFF800000000000ULL   // Direct map of all RAM
+#define TASK_STACK_AREA     0xFFFFFF0000000000ULL   // Task stacks (guard page below each)
 #define DEFAULT_HEAP_SIZE   0x100000    // 1MB fallback
 #define SECURE_REGION_SIZE  0x10000     // 64KB for keys
 
@@ -106,6 +109,34 @@ static inline void cli(void) { asm volatile("cli"); }
 static inline void sti(void) { asm volatile("sti"); }
 static inline void hlt(void) { asm volatile("hlt"); }
 
+// Disable interrupts, returning the previous RFLAGS for irq_restore()
+static inline uint64_t irq_save(void) {
+    uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint64_t flags) {
+    if (flags & 0x200) sti();   // IF was set
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t subleaf,
+                         uint32_t* a, uint32_t* b, uint32_t* c, uint32_t* d) {
+    asm volatile("cpuid"
+                 : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d)
+                 : "a"(leaf), "c"(subleaf));
+}
+
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t val) {
+    asm volatile("wrmsr" : : "c"(msr), "a"((uint32_t)val), "d"((uint32_t)(val >> 32)));
+}
+
 // =============================================================================
 // Debugging / Assertions
 // =============================================================================
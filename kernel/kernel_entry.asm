@@ -34,13 +34,20 @@
 
 [BITS 64]
 
+; Virtual base of the kernel image (must match kernel.h / kernel.ld)
+KERNEL_VMA_BASE equ 0xFFFFFFFF80000000
+
 ; External C kernel entry point
 extern kernel_main
 
 ; Export start symbol
 global _start
+global gdt64
 
-section .text
+; ==============================================================================
+; Boot Stub (linked and executed at the physical load address 0x100000)
+; ==============================================================================
+section .boot
 _start:
     ; DEBUG: Write 'K' (White on Red) to top-left corner of VGA buffer
     ; This confirms we have successfully jumped to the kernel code
@@ -53,9 +60,41 @@ _start:
     ; Clear Direction Flag (Standard GCC/SysV ABI requirement)
     cld
     
+    ; Alias the bootloader's 16MB identity map into the upper half:
+    ;   PML4[256]            -> direct physical map (PHYS_MAP_BASE)
+    ;   PML4[511]/PDPT[510]  -> kernel image (KERNEL_VMA_BASE)
+    ; paging_init() later replaces these tables entirely.
+    mov rax, cr3
+    and rax, ~0xFFF             ; RAX = PML4 (identity mapped)
+    mov rbx, [rax]              ; PML4[0] -> low PDPT
+    mov [rax + 256 * 8], rbx
+    
+    mov rcx, rbx
+    and rcx, ~0xFFF             ; RCX = low PDPT
+    mov rdx, [rcx]              ; PDPT[0] -> 16MB page directory
+    mov [boot_pdpt_high + 510 * 8], rdx
+    
+    mov rdx, boot_pdpt_high
+    or rdx, 3                   ; Present + Writable
+    mov [rax + 511 * 8], rdx
+    mov cr3, rax                ; Flush TLB
+    
+    ; Continue at the linked (upper half) address
+    mov rax, higher_half_entry
+    jmp rax
+
+align 4096
+boot_pdpt_high:
+    times 512 dq 0
+
+; ==============================================================================
+; Upper Half Entry
+; ==============================================================================
+section .text
+higher_half_entry:
     ; Setup Kernel Stack
-    ; Address: 0x200000 (2MB mark)
-    mov rsp, 0x200000
+    ; Address: 0x200000 (2MB mark) through the kernel image mapping
+    mov rsp, KERNEL_VMA_BASE + 0x200000
     and rsp, -16        ; Align stack to 16 bytes (ABI requirement)
     
     ; Initialize Stack Frame
@@ -90,7 +129,7 @@ _start:
     mov ss, ax
     
     ; Branch to C Kernel Main
-    ; RDI already contains the boot_info pointer passed by the bootloader
+    ; RDI still holds the (physical) boot_info pointer passed by the bootloader
     call kernel_main
 
     ; If kernel_main returns, halt the system
@@ -124,6 +163,11 @@ gdt64:
     db 10010010b    ; Access (Present, Ring0, Data, Read/Write)
     db 11001111b    ; Flags (4K Granularity)
     db 0            ; Base high
+    
+    ; TSS Descriptor (Offset 0x18, 16 bytes)
+    ; Filled in at runtime by tss_init() (idt.c)
+    dq 0
+    dq 0
 
 .pointer:
     dw $ - gdt64 - 1
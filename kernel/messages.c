@@ -9,6 +9,9 @@
 #include "libc.h"
 #include "buddy.h"
 #include "handlers.h"
+#include "port.h"
+#include "sblock.h"
+#include "sync.h"
 
 // Slab size table
 static const size_t slab_sizes[MSG_SLAB_COUNT] = {16, 64, 256, 1024, 4096};
@@ -19,9 +22,8 @@ struct slab_block {
 };
 static struct slab_block* slab_free[MSG_SLAB_COUNT];
 static uint32_t slab_alloc_count[MSG_SLAB_COUNT];
-
-// Task queues
-static struct msg_queue* task_queues[MAX_TASKS];
+static struct spinlock slab_lock;
+static struct lock_stats slab_lock_stats;
 
 // Select appropriate slab class for size
 static int size_to_slab(size_t size) {
@@ -32,9 +34,8 @@ static int size_to_slab(size_t size) {
 }
 
 void msg_init(void) {
-    for (int i = 0; i < MAX_TASKS; i++) {
-        task_queues[i] = NULL;
-    }
+    port_init();
+    spin_init(&slab_lock, &slab_lock_stats, "msg slab");
     for (int i = 0; i < MSG_SLAB_COUNT; i++) {
         slab_free[i] = NULL;
         slab_alloc_count[i] = 0;
@@ -49,17 +50,19 @@ struct message* msg_alloc(size_t data_size) {
     struct message* msg;
     
     // Check slab free list first
-    if (slab_free[slab]) {
-        msg = (struct message*)slab_free[slab];
-        slab_free[slab] = slab_free[slab]->next;
-    } else {
+    uint64_t flags = spin_lock_irqsave(&slab_lock);
+    msg = (struct message*)slab_free[slab];
+    if (msg) slab_free[slab] = slab_free[slab]->next;
+    spin_unlock_irqrestore(&slab_lock, flags);
+    
+    if (!msg) {
         // Allocate from buddy
         msg = (struct message*)buddy_alloc(total);
         if (!msg) return NULL;
-        slab_alloc_count[slab]++;
+        __atomic_add_fetch(&slab_alloc_count[slab], 1, __ATOMIC_RELAXED);
     }
     
-    memset(msg, 0, total);
+    memset(msg, 0, sizeof(struct message));    // Caller fills the data
     msg->slab_class = slab;
     msg->size = data_size;
     return msg;
@@ -67,126 +70,832 @@ struct message* msg_alloc(size_t data_size) {
 
 void msg_free(struct message* msg) {
     if (!msg) return;
+    msg_drop_payload(msg);
     
     // Return to slab free list
+    uint32_t slab = msg->slab_class;
     struct slab_block* blk = (struct slab_block*)msg;
-    blk->next = slab_free[msg->slab_class];
-    slab_free[msg->slab_class] = blk;
+    uint64_t flags = spin_lock_irqsave(&slab_lock);
+    blk->next = slab_free[slab];
+    slab_free[slab] = blk;
+    spin_unlock_irqrestore(&slab_lock, flags);
+}
+
+void msg_drop_payload(struct message* msg) {
+    struct sblock* blk = msg ? msg_sblock(msg) : NULL;
+    if (!blk) return;
+    sblock_free(blk);
+    memset(msg->data, 0, sizeof(blk));
+}
+
+struct msg_queue* msg_queue_create(uint32_t owner) {
+    struct msg_queue* queue = buddy_alloc(sizeof(struct msg_queue));
+    if (!queue) return NULL;
+    memset(queue, 0, sizeof(struct msg_queue));
+    queue->owner = owner;
+    queue->boost = PRIORITY_IDLE;
+    queue->capacity = MSG_QUEUE_DEFAULT;
+    queue->cap_min = MSG_QUEUE_MIN;
+    queue->cap_max = MSG_QUEUE_MAX;
+    return queue;
+}
+
+int msg_queue_set_limits(struct msg_queue* queue, uint32_t min, uint32_t max) {
+    if (!queue || min == 0 || min > max) return -1;
+    uint64_t irq = irq_save();
+    queue->cap_min = min;
+    queue->cap_max = max;
+    if (queue->capacity < min) queue->capacity = min;
+    if (queue->capacity > max) queue->capacity = max;
+    irq_restore(irq);
+    return 0;
+}
+
+void msg_queue_get_stats(struct msg_queue* queue, struct msg_queue_stats* out) {
+    if (!queue || !out) return;
+    *out = queue->stats;
+    out->capacity = queue->capacity;
+    out->queued = queue->count - queue->skip;
 }
 
+// Default queue of a task (its PID-keyed port), held: msg_queue_put() it
 static struct msg_queue* get_queue(uint32_t task_id) {
-    if (task_id >= MAX_TASKS) return NULL;
+    return port_task_queue(task_id, true);
+}
+
+// =============================================================================
+// SPSC Ring (one per sender/receiver pair)
+// =============================================================================
+// head/tail are free-running slot counters. The producer writes slots and
+// then publishes head with release; the consumer reads head with acquire,
+// copies the record out (or lends it, see msg_borrow) and hands the slots
+// back by releasing tail.
+
+static inline uint32_t ring_load(const volatile uint32_t* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void ring_store(volatile uint32_t* p, uint32_t v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static inline struct msg_record* ring_slot(struct msg_ring* ring, uint32_t pos) {
+    return (struct msg_record*)(ring->slots + (pos & (MSG_RING_SLOTS - 1)) * MSG_SLOT_SIZE);
+}
+
+static inline uint32_t record_slots(uint32_t size) {
+    return (sizeof(struct msg_record) + size + MSG_SLOT_SIZE - 1) / MSG_SLOT_SIZE;
+}
+
+// Producer side: write one record at *head without publishing it.
+// tail is the consumer index, loaded once per batch. False if full.
+static bool ring_write(struct msg_ring* ring, uint32_t* head, uint32_t tail,
+                       uint32_t sender, const struct msg_vec* v, uint64_t now) {
+    // Pointer messages carry the pointer itself, size is the pointee's
+    const void* data = msg_by_ref(v->type) ? (const void*)&v->data : v->data;
+    uint32_t copy = msg_by_ref(v->type) ? sizeof(void*) : v->size;
+    
+    uint32_t h = *head;
     
-    if (!task_queues[task_id]) {
-        task_queues[task_id] = (struct msg_queue*)buddy_alloc(sizeof(struct msg_queue));
-        if (task_queues[task_id]) {
-            memset(task_queues[task_id], 0, sizeof(struct msg_queue));
+    // Fast path: a single slot never needs padding
+    if (copy <= MSG_INLINE_MAX) {
+        if (h - tail >= MSG_RING_SLOTS) return false;
+        struct msg_record* r = ring_slot(ring, h);
+        r->sender_id = sender;
+        r->type = v->type;
+        r->size = v->size;
+        r->slots = 1;
+        r->timestamp = now;
+        if (data) memcpy(r->data, data, copy);
+        *head = h + 1;
+        return true;
+    }
+    
+    uint32_t free = MSG_RING_SLOTS - (h - tail);
+    uint32_t need = record_slots(copy);
+    
+    // Records are contiguous: pad out the end of the ring if needed
+    uint32_t pos = h & (MSG_RING_SLOTS - 1);
+    uint32_t pad = (pos + need > MSG_RING_SLOTS) ? MSG_RING_SLOTS - pos : 0;
+    if (pad + need > free) return false;
+    
+    if (pad) {
+        struct msg_record* p = ring_slot(ring, h);
+        p->type = MSG_RECORD_PAD;
+        p->slots = pad;
+        h += pad;
+    }
+    
+    struct msg_record* r = ring_slot(ring, h);
+    r->sender_id = sender;
+    r->type = v->type;
+    r->size = v->size;
+    r->slots = need;
+    r->timestamp = now;
+    if (data && copy > 0) memcpy(r->data, data, copy);
+    
+    *head = h + need;
+    return true;
+}
+
+// Consumer side: next record at the read cursor, skipping padding
+// (NULL if nothing unread)
+static struct msg_record* ring_peek(struct msg_ring* ring) {
+    uint32_t head = ring_load(&ring->head);
+    while (ring->rd != head) {
+        struct msg_record* r = ring_slot(ring, ring->rd);
+        if (r->type != MSG_RECORD_PAD) return r;
+        ring->rd += r->slots;
+    }
+    return NULL;
+}
+
+// Hand consumed slots back to the sender. Borrowed records pin the tail
+// until released; consumed ones are turned into padding so it can pass.
+static void ring_retire(struct msg_ring* ring) {
+    uint32_t tail = ring->tail;
+    if (ring->lent == 0) {
+        tail = ring->rd;
+    } else {
+        while (tail != ring->rd && ring_slot(ring, tail)->type == MSG_RECORD_PAD) {
+            tail += ring_slot(ring, tail)->slots;
         }
     }
-    return task_queues[task_id];
+    ring_store(&ring->tail, tail);
 }
 
-int msg_send(uint32_t sender, uint32_t receiver, uint32_t type,
-             const void* data, uint32_t size) {
-    if (size > MSG_MAX_SIZE) return -1;
+// Step the read cursor past r (returned by ring_peek)
+static void ring_advance(struct msg_ring* ring, struct msg_record* r) {
+    ring->rd += r->slots;
+}
+
+static void ring_pop(struct msg_ring* ring, struct msg_record* r) {
+    ring_advance(ring, r);
+    r->type = MSG_RECORD_PAD;
+    ring_retire(ring);
+}
+
+static bool ring_empty(struct msg_ring* ring) {
+    return ring_load(&ring->head) == ring->rd;
+}
+
+// Handle stored in an MSG_TYPE_SBLOCK record
+static inline struct sblock* record_sblock(const struct msg_record* r) {
+    struct sblock* blk;
+    __builtin_memcpy(&blk, r->data, sizeof(blk));
+    return blk;
+}
+
+// A record that will never be delivered drops its handle's reference
+static inline void record_drop(const struct msg_record* r) {
+    if (r->type == MSG_TYPE_SBLOCK) sblock_free(record_sblock(r));
+}
+
+// Free a destroyed queue once nobody holds it and nothing is borrowed
+// (interrupts disabled by the caller)
+static void msg_queue_reap(struct msg_queue* queue) {
+    if (!queue->closed || queue->users) return;
+    for (int c = 0; c < MSG_CLASSES; c++) {
+        for (int i = 0; i < MSG_SENDERS; i++) {
+            if (queue->rings[c][i].lent) return;
+        }
+    }
+    for (int c = 0; c < MSG_CLASSES; c++) {
+        for (int i = 0; i < MSG_SENDERS; i++) {
+            if (queue->rings[c][i].slots) page_free(queue->rings[c][i].slots, MSG_RING_ORDER);
+        }
+    }
+    buddy_free(queue);
+}
+
+void msg_queue_hold(struct msg_queue* queue) {
+    if (queue) __atomic_add_fetch(&queue->users, 1, __ATOMIC_RELAXED);
+}
+
+void msg_queue_put(struct msg_queue* queue) {
+    if (!queue) return;
+    uint64_t irq = irq_save();
+    queue->users--;
+    msg_queue_reap(queue);
+    irq_restore(irq);
+}
+
+void msg_queue_destroy(struct msg_queue* queue) {
+    if (!queue) return;
+    
+    // Blocked tasks recheck 'closed' when they run and fail
+    uint64_t irq = irq_save();
+    queue->closed = 1;
+    task_lend(&queue->loan, NULL, PRIORITY_IDLE);
+    queue->lent = 0;
+    wake_all(&queue->senders);
+    wake_all(&queue->waiters);
     
-    // Handle broadcast
-    if (receiver == 0) {
-        int success = 0;
-        for (uint32_t i = 1; i < MAX_TASKS; i++) {
-            if (i != sender && task_queues[i]) {
-                if (msg_send(sender, i, type, data, size) == 0) success++;
+    for (int c = 0; c < MSG_CLASSES; c++) {
+        for (int i = 0; i < MSG_SENDERS; i++) {
+            struct msg_ring* ring = &queue->rings[c][i];
+            if (!ring->slots) continue;
+            
+            struct msg_record* r;
+            while ((r = ring_peek(ring)) != NULL) {
+                record_drop(r);
+                ring_advance(ring, r);
             }
         }
-        return success > 0 ? 0 : -1;
     }
+    queue->count = 0;
+    queue->skip = 0;
+    msg_queue_reap(queue);
+    irq_restore(irq);
+}
+
+// Slot held by sender 'pid', taken on its first send if 'take' (-1 if
+// none, or all are held). Interrupts disabled by the caller.
+static int msg_sender_slot(struct msg_queue* queue, uint32_t pid, bool take) {
+    for (uint64_t used = queue->slot_used; used; used &= used - 1) {
+        int s = __builtin_ctzll(used);
+        if (queue->sender[s] == pid) return s;
+    }
+    uint64_t free = ~queue->slot_used & ((1ULL << MSG_SENDERS) - 1);
+    if (!take || !free) return -1;
     
-    struct msg_queue* queue = get_queue(receiver);
-    if (!queue) return -1;
-    if (queue->count >= MSG_QUEUE_SIZE) return -1;
+    int s = __builtin_ctzll(free);
+    queue->slot_used |= 1ULL << s;
+    queue->sender[s] = pid;
+    return s;
+}
+
+// Recycle slot s once its sender has exited and none of its records is
+// queued or borrowed (interrupts disabled by the caller)
+static void msg_slot_reclaim(struct msg_queue* queue, int s) {
+    uint64_t bit = 1ULL << s;
+    if (!(queue->slot_gone & bit)) return;
+    for (int c = 0; c < MSG_CLASSES; c++) {
+        struct msg_ring* ring = &queue->rings[c][s];
+        if (!ring_empty(ring) || ring->lent) return;
+    }
+    for (int c = 0; c < MSG_CLASSES; c++) {
+        struct msg_ring* ring = &queue->rings[c][s];
+        if (ring->slots) page_free(ring->slots, MSG_RING_ORDER);
+        memset(ring, 0, sizeof(*ring));
+    }
+    queue->slot_gone &= ~bit;
+    queue->slot_used &= ~bit;
+}
+
+void msg_queue_sender_exit(struct msg_queue* queue, uint32_t pid) {
+    if (!queue) return;
+    uint64_t irq = irq_save();
+    int s = msg_sender_slot(queue, pid, false);
+    if (s >= 0) {
+        queue->slot_gone |= 1ULL << s;
+        msg_slot_reclaim(queue, s);
+    }
+    irq_restore(irq);
+}
+
+// How many of n new messages fit under the queue's capacity. Grows the
+// capacity up to cap_max first, then applies the sender's policy. The
+// result is reserved until msg_commit(), so concurrent senders cannot
+// both claim the same room; *evicted is what DROP_OLDEST added to skip.
+static uint32_t msg_admit(struct msg_queue* queue, uint32_t n, uint32_t flags,
+                          uint32_t* evicted) {
+    uint64_t irq = irq_save();
+    *evicted = 0;
+    for (;;) {
+        if (queue->closed) {
+            n = 0;
+            break;
+        }
+        uint32_t live = queue->count + queue->reserved - queue->skip;
+        uint32_t room = (queue->capacity > live) ? queue->capacity - live : 0;
+        if (room >= n) break;
+        
+        if (queue->capacity < queue->cap_max) {
+            queue->capacity = (queue->capacity * 2 < queue->cap_max) ? queue->capacity * 2 : queue->cap_max;
+            continue;
+        }
+        if (flags & MSG_SEND_DROP_OLDEST) {
+            // The receiver discards that many before its next message
+            *evicted = n - room;
+            queue->skip += *evicted;
+            queue->stats.dropped += *evicted;
+            break;
+        }
+        if ((flags & MSG_SEND_BLOCK) && room == 0 && current_task) {
+            wait_queue_sleep(&queue->senders, TASK_BLOCKED, 0);
+            continue;
+        }
+        n = room;
+        break;
+    }
+    queue->reserved += n;
+    irq_restore(irq);
+    return n;
+}
+
+// Settle an admission: n of the admitted records were published. Evictions
+// made for records that never got queued are undone. Returns the number
+// of messages now pending.
+static uint32_t msg_commit(struct msg_queue* queue, uint32_t admitted,
+                           uint32_t evicted, uint32_t n) {
+    uint64_t irq = irq_save();
+    queue->reserved -= admitted;
+    uint32_t undo = (admitted - n < evicted) ? admitted - n : evicted;
+    queue->skip -= undo;
+    queue->stats.dropped -= undo;
     
-    struct message* msg = msg_alloc(size);
-    if (!msg) return -1;
+    uint32_t queued = __atomic_add_fetch(&queue->count, n, __ATOMIC_RELAXED);
+    if (queue->skip > queued) queue->skip = queued;     // Ring filled early
+    queued -= queue->skip;
+    queue->stats.enqueued += n;
+    if (queued > queue->stats.high_water) queue->stats.high_water = queued;
+    if (admitted > n && queue->senders.head) wake_one(&queue->senders);   // Unused room
+    irq_restore(irq);
+    return queued;
+}
+
+static uint32_t msg_class(uint32_t flags) {
+    if (flags & MSG_SEND_URGENT) return MSG_CLASS_URGENT;
+    if (flags & MSG_SEND_BULK) return MSG_CLASS_BULK;
+    return MSG_CLASS_NORMAL;
+}
+
+// Run the queue's owner at priority p, or its own if that is better
+// (PRIORITY_IDLE ends the loan). Remembers what the loan guarantees the
+// owner so senders that do not outrank it skip the lookup.
+static void msg_lend_priority(struct msg_queue* queue, uint8_t p) {
+    struct task* t = task_find(queue->owner);
+    if (!t) return;
+    if (p >= t->base_priority) p = PRIORITY_IDLE;
+    task_lend(&queue->loan, t, p);
+    queue->boost = (p < t->base_priority) ? p : t->base_priority;
+    queue->lent = queue->loan.to != NULL;
+}
+
+// Reference for a queued sblock handle, taken on the sender's behalf.
+// The sender must be able to read the block itself: delivery grants
+// the receiver read access, which must not exceed the sender's own.
+static int msg_hold_sblock(struct msg_queue* queue, uint32_t sender, const struct msg_vec* v) {
+    struct sblock* blk = (struct sblock*)v->data;
+    struct task* s = task_find(sender);
+    if (!sblock_can_access(blk, s ? s->uid : UID_USER, SBLOCK_READ)) return -1;
     
-    msg->sender_id = sender;
-    msg->receiver_id = receiver;
-    msg->type = type;
-    msg->timestamp = get_timer_ticks();
+    struct task* t = task_find(queue->owner);
+    return sblock_share(blk, t ? t->uid : UID_USER);
+}
+
+// Append records to the sender's ring with one publish, one ready flag
+// and one wakeup, then hand the CPU to a woken receiver that outranks us.
+// Returns the number of records queued (stops early when the queue is at
+// capacity or the ring is full; those count as dropped).
+int msg_queue_send(struct msg_queue* queue, uint32_t sender,
+                   const struct msg_vec* vec, uint32_t count, uint32_t flags) {
+    if (!queue || !vec || queue->closed) return -1;
     
-    if (data && size > 0) {
-        memcpy(msg->data, data, size);
+    uint64_t irq = irq_save();
+    int slot = msg_sender_slot(queue, sender, true);
+    irq_restore(irq);
+    if (slot < 0) {
+        __atomic_add_fetch(&queue->stats.dropped, count, __ATOMIC_RELAXED);
+        return -1;
     }
     
-    queue->messages[queue->write_pos] = msg;
-    queue->write_pos = (queue->write_pos + 1) % MSG_QUEUE_SIZE;
-    queue->count++;
+    uint32_t evicted;
+    uint32_t admitted = msg_admit(queue, count, flags, &evicted);
+    if (queue->closed) {
+        msg_commit(queue, admitted, evicted, 0);
+        return -1;
+    }
     
-    return 0;
+    uint32_t cls = msg_class(flags);
+    struct msg_ring* ring = &queue->rings[cls][slot];
+    if (!ring->slots) {
+        ring->slots = page_alloc(MSG_RING_ORDER);
+        if (!ring->slots) {
+            msg_commit(queue, admitted, evicted, 0);
+            return -1;
+        }
+    }
+    
+    uint32_t head = ring->head;
+    uint32_t tail = ring_load(&ring->tail);
+    uint64_t now = get_timer_ticks();
+    uint32_t n = 0;
+    while (n < admitted && (msg_by_ref(vec[n].type) || vec[n].size <= MSG_MAX_SIZE)) {
+        uint32_t h = head;
+        if (!ring_write(ring, &head, tail, sender, &vec[n], now)) break;
+        if (vec[n].type == MSG_TYPE_SBLOCK && msg_hold_sblock(queue, sender, &vec[n]) != 0) {
+            head = h;       // Not shareable: unwrite it
+            break;
+        }
+        n++;
+    }
+    __atomic_add_fetch(&queue->stats.dropped, count - n, __ATOMIC_RELAXED);
+    if (n == 0) {
+        msg_commit(queue, admitted, evicted, 0);
+        return 0;
+    }
+    ring->prio = current_task ? current_task->priority : PRIORITY_IDLE;
+    ring_store(&ring->head, head);
+    
+    __atomic_fetch_or(&queue->ready[cls], 1ULL << slot, __ATOMIC_RELEASE);
+    msg_commit(queue, admitted, evicted, n);
+    
+    irq = irq_save();
+    if (ring->prio < queue->boost) msg_lend_priority(queue, ring->prio);
+    struct task* woken = wake_one(&queue->waiters);
+    irq_restore(irq);
+    
+    if (woken && current_task && woken->priority < current_task->priority) {
+        yield();
+    }
+    return (int)n;
 }
 
-int msg_send_ptr(uint32_t sender, uint32_t receiver, void* ptr, uint32_t size) {
+// Send to a task's default queue
+static int msg_send_task(uint32_t sender, uint32_t receiver, const struct msg_vec* vec,
+                         uint32_t count, uint32_t flags) {
     struct msg_queue* queue = get_queue(receiver);
-    if (!queue) return -1;
-    if (queue->count >= MSG_QUEUE_SIZE) return -1;
+    int n = msg_queue_send(queue, sender, vec, count, flags);
+    msg_queue_put(queue);
+    return n;
+}
+
+int msg_send(uint32_t sender, uint32_t receiver, uint32_t type,
+             const void* data, uint32_t size) {
+    return msg_send_flags(sender, receiver, type, data, size, MSG_SEND_NONBLOCK);
+}
+
+int msg_send_flags(uint32_t sender, uint32_t receiver, uint32_t type,
+                   const void* data, uint32_t size, uint32_t flags) {
+    if (size > MSG_MAX_SIZE) return -1;
     
-    struct message* msg = msg_alloc(sizeof(void*));
-    if (!msg) return -1;
+    struct msg_vec v = { type, size, data };
     
-    msg->sender_id = sender;
-    msg->receiver_id = receiver;
-    msg->type = MSG_TYPE_POINTER;
-    msg->size = size;
-    msg->timestamp = get_timer_ticks();
-    *(void**)msg->data = ptr;
+    // Broadcast: every task that has a default port
+    if (receiver == 0) return port_broadcast(sender, &v);
     
-    queue->messages[queue->write_pos] = msg;
-    queue->write_pos = (queue->write_pos + 1) % MSG_QUEUE_SIZE;
-    queue->count++;
+    return msg_send_task(sender, receiver, &v, 1, flags) == 1 ? 0 : -1;
+}
+
+int msg_send_ptr(uint32_t sender, uint32_t receiver, void* ptr, uint32_t size) {
+    struct msg_vec v = { MSG_TYPE_POINTER, size, ptr };
+    return msg_send_task(sender, receiver, &v, 1, MSG_SEND_NONBLOCK) == 1 ? 0 : -1;
+}
+
+int msg_send_sblock(uint32_t sender, uint32_t receiver, struct sblock* blk, uint32_t flags) {
+    if (!blk) return -1;
     
-    return 0;
+    struct msg_vec v = { MSG_TYPE_SBLOCK, blk->size, blk };
+    if (receiver == 0) return port_broadcast(sender, &v);
+    return msg_send_task(sender, receiver, &v, 1, flags) == 1 ? 0 : -1;
+}
+
+int msg_send_batch(uint32_t sender, uint32_t receiver,
+                   const struct msg_vec* vec, uint32_t count) {
+    if (!vec || receiver == 0) return -1;
+    if (count == 0) return 0;
+    return msg_send_task(sender, receiver, vec, count, MSG_SEND_NONBLOCK);
+}
+
+// Record r is leaving 'ring': lend the owner the best priority among the
+// senders still queued, or return the loan once none outrank it
+static void msg_update_boost(struct msg_queue* queue, struct msg_ring* ring,
+                             const struct msg_record* r) {
+    uint8_t p = PRIORITY_IDLE;
+    for (int c = 0; c < MSG_CLASSES; c++) {
+        uint64_t ready = __atomic_load_n(&queue->ready[c], __ATOMIC_ACQUIRE);
+        while (ready) {
+            struct msg_ring* q = &queue->rings[c][__builtin_ctzll(ready)];
+            ready &= ready - 1;
+            uint32_t rd = (q == ring) ? q->rd + r->slots : q->rd;
+            if (ring_load(&q->head) != rd && q->prio < p) p = q->prio;
+        }
+    }
+    if (p != queue->boost) msg_lend_priority(queue, p);
+}
+
+// A record left the queue: telemetry, shrink after a burst, priority
+// loan, wake a sender blocked on capacity. 'delivered' is false for
+// drop-oldest discards and msg_clear(), which drop sblock references.
+static void msg_account(struct msg_queue* queue, struct msg_ring* ring,
+                        const struct msg_record* r, bool delivered) {
+    uint32_t left = __atomic_sub_fetch(&queue->count, 1, __ATOMIC_RELAXED);
+    if (delivered) {
+        queue->stats.dequeued++;
+        queue->stats.wait_total += get_timer_ticks() - r->timestamp;
+    } else {
+        record_drop(r);
+    }
+    
+    // Senders resize and admit against the capacity: keep them out
+    uint64_t irq = irq_save();
+    if (queue->capacity > queue->cap_min && left < queue->capacity / 4) {
+        queue->capacity = (queue->capacity / 2 > queue->cap_min) ? queue->capacity / 2 : queue->cap_min;
+    }
+    if (left == 0 && !queue->lent) queue->boost = PRIORITY_IDLE;    // Re-read owner next burst
+    if (queue->lent) msg_update_boost(queue, ring, r);
+    if (queue->senders.head) wake_one(&queue->senders);
+    irq_restore(irq);
+}
+
+// Next non-empty ring of a class, round robin over senders (NULL if none)
+static struct msg_ring* msg_class_ring(struct msg_queue* queue, uint32_t c) {
+    for (;;) {
+        uint64_t ready = __atomic_load_n(&queue->ready[c], __ATOMIC_ACQUIRE);
+        if (!ready) return NULL;
+        
+        // First ready sender at or after queue->next
+        uint32_t start = queue->next[c];
+        uint64_t above = ready & (~0ULL << start);
+        uint32_t s = (uint32_t)__builtin_ctzll(above ? above : ready);
+        
+        struct msg_ring* ring = &queue->rings[c][s];
+        if (!ring_empty(ring)) {
+            queue->next[c] = (s + 1) % MSG_SENDERS;
+            return ring;
+        }
+        
+        // Drained: clear the bit, then recheck so a racing send is not lost
+        __atomic_fetch_and(&queue->ready[c], ~(1ULL << s), __ATOMIC_ACQ_REL);
+        if (!ring_empty(ring)) {
+            __atomic_fetch_or(&queue->ready[c], 1ULL << s, __ATOMIC_RELEASE);
+        } else if (queue->slot_gone & (1ULL << s)) {
+            uint64_t irq = irq_save();
+            msg_slot_reclaim(queue, (int)s);
+            irq_restore(irq);
+        }
+    }
+}
+
+// Ring to deliver from next: most urgent class first
+static struct msg_ring* msg_next_ring(struct msg_queue* queue) {
+    for (uint32_t c = 0; c < MSG_CLASSES; c++) {
+        struct msg_ring* ring = msg_class_ring(queue, c);
+        if (ring) return ring;
+    }
+    return NULL;
+}
+
+// Ring to evict from for DROP_OLDEST: the one whose next record was
+// queued first, across all senders and classes (ties: least urgent class)
+static struct msg_ring* msg_victim_ring(struct msg_queue* queue) {
+    struct msg_ring* victim = NULL;
+    uint64_t oldest = 0;
+    for (int c = MSG_CLASSES - 1; c >= 0; c--) {
+        uint64_t ready = __atomic_load_n(&queue->ready[c], __ATOMIC_ACQUIRE);
+        while (ready) {
+            struct msg_ring* ring = &queue->rings[c][__builtin_ctzll(ready)];
+            ready &= ready - 1;
+            struct msg_record* r = ring_peek(ring);
+            if (r && (!victim || r->timestamp < oldest)) {
+                victim = ring;
+                oldest = r->timestamp;
+            }
+        }
+    }
+    return victim;
 }
 
 int msg_receive(uint32_t receiver, struct message* out_msg) {
-    if (!out_msg) return -1;
+    return msg_receive_timeout(receiver, out_msg, MSG_MAX_SIZE, 0);
+}
+
+// Wait for a queued record (interrupts disabled by the caller).
+// Returns its ring with *out set, or NULL on timeout.
+static struct msg_ring* msg_wait(struct msg_queue* queue, struct msg_record** out,
+                                 uint64_t deadline) {
+    struct msg_ring* ring;
+    for (;;) {
+        if (queue->closed) return NULL;
+        ring = queue->skip ? msg_victim_ring(queue) : msg_next_ring(queue);
+        if (ring) {
+            if (!(*out = ring_peek(ring))) continue;    // Only padding left
+            if (!queue->skip) break;
+            
+            // Dropped by a DROP_OLDEST sender
+            queue->skip--;
+            msg_account(queue, ring, *out, false);
+            ring_pop(ring, *out);
+            continue;
+        }
+        if (!current_task) {
+            // Before the scheduler runs there is nobody to switch to
+            sti();
+            hlt();
+            cli();
+            continue;
+        }
+        // Another receiver may have taken the message: wait out the rest
+        uint64_t left = 0;
+        if (deadline) {
+            uint64_t now = get_timer_ticks();
+            left = (now < deadline) ? deadline - now : 0;
+        }
+        if ((deadline && left == 0) ||
+            wait_queue_sleep(&queue->waiters, TASK_WAITING_MSG, left) < 0) {
+            return NULL;
+        }
+    }
+    return ring;
+}
+
+// An sblock handle reaches its receiver: the receiver's UID may read the
+// block and the record's reference moves to the message
+static void msg_deliver_sblock(uint32_t receiver, const struct msg_record* r) {
+    struct task* t = task_find(receiver);
+    sblock_grant_read(record_sblock(r), t ? t->uid : UID_USER);
+}
+
+// Copy a record out as a message with at most max_size data bytes
+static void msg_copy_out(uint32_t receiver, const struct msg_record* r,
+                         struct message* out_msg, uint32_t max_size) {
+    uint32_t copy = msg_by_ref(r->type) ? sizeof(void*) : r->size;
+    
+    out_msg->sender_id = r->sender_id;
+    out_msg->receiver_id = receiver;
+    out_msg->type = r->type;
+    out_msg->size = r->size;
+    out_msg->slab_class = 0;
+    out_msg->flags = 0;
+    out_msg->timestamp = r->timestamp;
+    if (copy > max_size) {
+        copy = max_size;
+        out_msg->flags |= MSG_FLAG_TRUNCATED;
+    }
+    if (r->type == MSG_TYPE_SBLOCK) {
+        // A cut-off handle is useless: drop its reference here
+        if (out_msg->flags & MSG_FLAG_TRUNCATED) {
+            record_drop(r);
+        } else {
+            msg_deliver_sblock(receiver, r);
+        }
+    }
+    memcpy(out_msg->data, r->data, copy);
+}
+
+// Only the owner takes messages from a default queue, as with ports.
+// Kernel code running before the scheduler has no task and may.
+static bool msg_is_receiver(uint32_t receiver) {
+    return !current_task || current_task->pid == receiver;
+}
+
+int msg_receive_timeout(uint32_t receiver, struct message* out_msg,
+                        uint32_t max_size, uint64_t timeout_ms) {
+    if (!msg_is_receiver(receiver)) return -1;
+    struct msg_queue* queue = get_queue(receiver);
+    int rc = msg_queue_receive(queue, receiver, out_msg, max_size, timeout_ms);
+    msg_queue_put(queue);
+    return rc;
+}
+
+int msg_queue_receive(struct msg_queue* queue, uint32_t receiver, struct message* out_msg,
+                      uint32_t max_size, uint64_t timeout_ms) {
+    if (!queue || !out_msg) return -1;
+    
+    uint64_t deadline = timeout_ms ? get_timer_ticks() + timeout_ms : 0;
+    struct msg_record* r = NULL;
+    
+    uint64_t flags = irq_save();
+    struct msg_ring* ring = msg_wait(queue, &r, deadline);
+    irq_restore(flags);
+    if (!ring) return queue->closed ? -1 : MSG_TIMEOUT;
+    
+    msg_copy_out(receiver, r, out_msg, max_size);
+    msg_account(queue, ring, r, true);
+    ring_pop(ring, r);
+    return 0;
+}
+
+int msg_receive_many(uint32_t receiver, void* buf, size_t buf_size,
+                     uint32_t max, uint64_t timeout_ms) {
+    if (!buf || buf_size < sizeof(struct message) || max == 0) return -1;
+    if (!msg_is_receiver(receiver)) return -1;
     
     struct msg_queue* queue = get_queue(receiver);
     if (!queue) return -1;
     
-    while (queue->count == 0) {
-        hlt();
+    uint64_t deadline = timeout_ms ? get_timer_ticks() + timeout_ms : 0;
+    struct msg_record* r = NULL;
+    
+    // Block only for the first message, then take whatever is queued
+    uint64_t flags = irq_save();
+    struct msg_ring* ring = msg_wait(queue, &r, deadline);
+    irq_restore(flags);
+    if (!ring) {
+        msg_queue_put(queue);
+        return MSG_TIMEOUT;
     }
     
-    struct message* msg = queue->messages[queue->read_pos];
-    memcpy(out_msg, msg, sizeof(struct message) + msg->size);
+    uint8_t* out = buf;
+    size_t room = buf_size;
+    uint32_t n = 0;
+    while (ring && r) {
+        uint32_t len = msg_by_ref(r->type) ? sizeof(void*) : r->size;
+        size_t need = sizeof(struct message) + MSG_ALIGN(len);
+        if (need > room) {
+            if (n > 0) break;
+            len = (uint32_t)(room - sizeof(struct message)) & ~7U;   // First one: truncate
+            need = sizeof(struct message) + len;
+        }
+        
+        msg_copy_out(receiver, r, (struct message*)out, len);
+        msg_account(queue, ring, r, true);
+        ring_pop(ring, r);
+        out += need;
+        room -= need;
+        if (++n == max || queue->skip) break;
+        
+        // Rings holding only padding drain and drop out of the mask
+        r = NULL;
+        while ((ring = msg_next_ring(queue)) != NULL && !(r = ring_peek(ring))) {}
+    }
+    msg_queue_put(queue);
+    return (int)n;
+}
+
+const struct msg_record* msg_borrow(uint32_t receiver, uint64_t timeout_ms) {
+    if (!msg_is_receiver(receiver)) return NULL;
+    struct msg_queue* queue = get_queue(receiver);
+    if (!queue) return NULL;
     
-    msg_free(msg);
-    queue->read_pos = (queue->read_pos + 1) % MSG_QUEUE_SIZE;
-    queue->count--;
+    uint64_t deadline = timeout_ms ? get_timer_ticks() + timeout_ms : 0;
+    struct msg_record* r = NULL;
     
-    return 0;
+    uint64_t flags = irq_save();
+    struct msg_ring* ring = msg_wait(queue, &r, deadline);
+    irq_restore(flags);
+    if (ring) {
+        msg_account(queue, ring, r, true);
+        if (r->type == MSG_TYPE_SBLOCK) msg_deliver_sblock(receiver, r);
+        ring_advance(ring, r);
+        ring->lent++;
+    }
+    msg_queue_put(queue);
+    return ring ? r : NULL;
+}
+
+void msg_release(uint32_t receiver, const struct msg_record* r) {
+    if (!r || !msg_is_receiver(receiver)) return;
+    struct msg_queue* queue = port_task_queue(receiver, false);
+    if (!queue) return;
+    
+    // The ring of whichever class the record was sent in. A slot with a
+    // record out is not recycled, so the sender still holds it.
+    uint64_t irq = irq_save();
+    int s = msg_sender_slot(queue, r->sender_id, false);
+    struct msg_ring* ring = NULL;
+    const uint8_t* p = (const uint8_t*)r;
+    for (int c = 0; c < MSG_CLASSES && s >= 0 && !ring; c++) {
+        struct msg_ring* q = &queue->rings[c][s];
+        if (q->lent && p >= q->slots && p < q->slots + MSG_RING_SLOTS * MSG_SLOT_SIZE) ring = q;
+    }
+    if (ring) {
+        record_drop(r);
+        ((struct msg_record*)r)->type = MSG_RECORD_PAD;
+        ring->lent--;
+        ring_retire(ring);
+        msg_slot_reclaim(queue, s);
+    }
+    irq_restore(irq);
+    msg_queue_put(queue);
 }
 
 bool msg_available(uint32_t receiver) {
-    if (receiver >= MAX_TASKS) return false;
-    struct msg_queue* queue = task_queues[receiver];
-    return queue && queue->count > 0;
+    return msg_count(receiver) > 0;
 }
 
 uint32_t msg_count(uint32_t receiver) {
-    if (receiver >= MAX_TASKS) return 0;
-    struct msg_queue* queue = task_queues[receiver];
-    return queue ? queue->count : 0;
+    struct msg_queue* queue = port_task_queue(receiver, false);
+    uint32_t n = queue ? queue->count - queue->skip : 0;
+    msg_queue_put(queue);
+    return n;
 }
 
 void msg_clear(uint32_t receiver) {
-    if (receiver >= MAX_TASKS) return;
-    struct msg_queue* queue = task_queues[receiver];
+    if (!msg_is_receiver(receiver)) return;
+    struct msg_queue* queue = port_task_queue(receiver, false);
     if (!queue) return;
     
-    // Free all queued messages
-    while (queue->count > 0) {
-        msg_free(queue->messages[queue->read_pos]);
-        queue->read_pos = (queue->read_pos + 1) % MSG_QUEUE_SIZE;
-        queue->count--;
+    // Drop everything queued (consumer side: advance each tail to head)
+    struct msg_ring* ring;
+    struct msg_record* r;
+    while ((ring = msg_next_ring(queue)) != NULL) {
+        while ((r = ring_peek(ring)) != NULL) {
+            msg_account(queue, ring, r, false);
+            ring_pop(ring, r);
+        }
     }
-}
\ No newline at end of file
+    uint64_t irq = irq_save();
+    queue->skip = 0;
+    irq_restore(irq);
+    msg_queue_put(queue);
+}
+
+int msg_set_limits(uint32_t receiver, uint32_t min, uint32_t max) {
+    struct msg_queue* queue = get_queue(receiver);
+    int rc = msg_queue_set_limits(queue, min, max);
+    msg_queue_put(queue);
+    return rc;
+}
@@ -9,6 +9,7 @@
 #define MESSAGES_H
 
 #include "kernel.h"
+#include "process.h"
 
 // Message Size Classes (slab allocator)
 #define MSG_SLAB_16     0
@@ -19,7 +20,38 @@
 #define MSG_SLAB_COUNT  5
 
 #define MSG_MAX_SIZE    4096
-#define MSG_QUEUE_SIZE  64
+
+// Channel Rings: one per sender slot and class. A sender takes a slot of
+// the queue on its first send and keeps it until it has exited and the
+// receiver has drained what it queued.
+#define MSG_SENDERS     32      // Slots per queue (one ready bit each)
+#define MSG_SLOT_SIZE   64      // One cache line
+#define MSG_RING_ORDER  2       // 16KB of slots per channel
+#define MSG_RING_SLOTS  256     // Holds a max-size record even after padding
+
+// msg_receive_timeout() result when no message arrived in time
+#define MSG_TIMEOUT     (-2)
+
+// Queue capacity in messages. Grows by doubling under load up to the
+// maximum, halves back once the queue drains below a quarter.
+#define MSG_QUEUE_DEFAULT   64
+#define MSG_QUEUE_MIN       16
+#define MSG_QUEUE_MAX       1024
+
+// What a sender does when the queue is at its maximum capacity
+#define MSG_SEND_NONBLOCK     0x00  // Fail fast (counted as dropped)
+#define MSG_SEND_BLOCK        0x01  // Sleep until the receiver makes room
+#define MSG_SEND_DROP_OLDEST  0x02  // Discard the oldest queued messages
+
+// Delivery class, also a send flag. A receiver always drains urgent before
+// normal before bulk; within a class senders are served round robin.
+#define MSG_CLASS_URGENT    0
+#define MSG_CLASS_NORMAL    1
+#define MSG_CLASS_BULK      2
+#define MSG_CLASSES         3
+
+#define MSG_SEND_URGENT       0x04  // Control traffic, overtakes the rest
+#define MSG_SEND_BULK         0x08  // Data traffic, delivered last
 
 // Standard Message Types
 enum msg_type {
@@ -28,8 +60,12 @@ enum msg_type {
     MSG_TYPE_REQUEST = 3,
     MSG_TYPE_RESPONSE = 4,
     MSG_TYPE_POINTER = 5,   // Zero-copy pointer message
+    MSG_TYPE_SBLOCK = 6,    // Zero-copy sblock handle (carries a reference)
 };
 
+// Message Flags
+#define MSG_FLAG_TRUNCATED  0x01    // Data cut to the receiver's buffer
+
 // Message Envelope (variable size)
 struct message {
     uint32_t sender_id;
@@ -42,31 +78,198 @@ struct message {
     uint8_t  data[];        // Flexible array member
 };
 
-// Message Queue (uses pointers to messages)
+// Batch Send Entry (POINTER/SBLOCK messages: data is the pointer, size the
+// pointee's)
+struct msg_vec {
+    uint32_t type;
+    uint32_t size;
+    const void* data;
+};
+
+// msg_receive_many() packs messages back to back, data padded to 8 bytes
+#define MSG_ALIGN(n)    (((n) + 7) & ~7U)
+
+// Types whose data is a pointer to the payload, not the payload
+static inline bool msg_by_ref(uint32_t type) {
+    return type == MSG_TYPE_POINTER || type == MSG_TYPE_SBLOCK;
+}
+
+static inline uint32_t msg_data_len(const struct message* m) {
+    return msg_by_ref(m->type) ? sizeof(void*) : m->size;
+}
+
+// Handle carried by an MSG_TYPE_SBLOCK message (NULL once dropped)
+struct sblock;
+static inline struct sblock* msg_sblock(const struct message* m) {
+    struct sblock* blk = NULL;
+    if (m->type == MSG_TYPE_SBLOCK && !(m->flags & MSG_FLAG_TRUNCATED)) {
+        __builtin_memcpy(&blk, m->data, sizeof(blk));
+    }
+    return blk;
+}
+
+static inline struct message* msg_next(struct message* m) {
+    return (struct message*)((uint8_t*)m + sizeof(struct message) + MSG_ALIGN(msg_data_len(m)));
+}
+
+// Queued record: header + inline payload, spanning whole slots
+#define MSG_RECORD_PAD  0       // Filler up to the end of the ring
+
+struct msg_record {
+    uint32_t sender_id;
+    uint32_t type;
+    uint32_t size;          // Message size (pointee size for POINTER)
+    uint32_t slots;         // Slots used, header included
+    uint64_t timestamp;
+    uint8_t  data[];
+};
+
+// Payloads up to this size share the header's slot (signals, requests,
+// the 8-byte sys_msgsnd() payload) and take the inline fast path
+#define MSG_INLINE_MAX  (MSG_SLOT_SIZE - sizeof(struct msg_record))
+
+// Single-producer/single-consumer ring, one per sender/receiver pair.
+// Producer and consumer indices live on separate cache lines.
+struct msg_ring {
+    volatile uint32_t head;     // Written by the sender only
+    uint8_t  prio;              // Sender's priority at its last send
+    uint8_t* slots;             // MSG_RING_SLOTS * MSG_SLOT_SIZE, lazily allocated
+    uint8_t  pad0[MSG_SLOT_SIZE - 16];
+    volatile uint32_t tail;     // Written by the receiver only: slots released
+    uint32_t rd;                // Receiver's read cursor (tail <= rd <= head)
+    uint32_t lent;              // Records borrowed and not yet released
+    uint8_t  pad1[MSG_SLOT_SIZE - 12];
+} __attribute__((aligned(64)));
+
+// Per-queue overflow telemetry
+struct msg_queue_stats {
+    uint64_t enqueued;
+    uint64_t dequeued;
+    uint64_t dropped;           // Refused, evicted or lost to a full ring
+    uint64_t wait_total;        // Sum of queueing delays (ticks) of dequeued
+    uint32_t high_water;        // Most messages ever pending at once
+    uint32_t capacity;          // Snapshot: current capacity
+    uint32_t queued;            // Snapshot: pending messages
+};
+
+// Per-receiver queue: a ring per class and sender slot, and a bitmask of
+// non-empty rings per class
 struct msg_queue {
-    struct message* messages[MSG_QUEUE_SIZE];
-    uint32_t read_pos;
-    uint32_t write_pos;
-    uint32_t count;
+    struct msg_ring rings[MSG_CLASSES][MSG_SENDERS];
+    uint64_t ready[MSG_CLASSES];    // Bit s set: rings[c][s] may hold records
+    uint32_t next[MSG_CLASSES];     // Round-robin start for fairness
+    uint32_t sender[MSG_SENDERS];   // PID holding each slot
+    uint64_t slot_used;         // Bit s set: slot s is held
+    uint64_t slot_gone;         // Bit s set: its sender exited, recycle once drained
+    uint32_t owner;             // Receiving task, inherits senders' priority
+    uint8_t  boost;             // Priority the owner is assured: loan or own (IDLE: unknown)
+    uint8_t  lent;              // Owner runs on a sender's priority
+    struct prio_loan loan;      // Best queued sender's priority, lent to the owner
+    uint32_t count;             // Pending messages (all rings)
+    uint32_t skip;              // Oldest pending to discard (DROP_OLDEST)
+    uint32_t reserved;          // Admitted by senders, not yet published
+    uint32_t capacity;          // Current limit, within [cap_min, cap_max]
+    uint32_t cap_min;
+    uint32_t cap_max;
+    uint8_t  closed;            // Destroyed: sends and receives fail
+    uint32_t users;             // Holds (msg_queue_hold) deferring the free
+    struct wait_queue waiters;  // Receivers parked in TASK_WAITING_MSG
+    struct wait_queue senders;  // MSG_SEND_BLOCK senders waiting for room
+    struct msg_queue_stats stats;
 };
 
 // Initialize IPC System (with slab allocator)
 void msg_init(void);
 
-// Allocate/Free message buffers
+// Queues (owned by ports, see port.h). 'owner' is the receiving task.
+// Destroying a queue drops what is queued and fails blocked senders and
+// receivers; the memory goes once the last hold is put and no borrowed
+// record is out.
+struct msg_queue* msg_queue_create(uint32_t owner);
+void msg_queue_destroy(struct msg_queue* queue);
+
+// Keep a queue's memory valid across a call that may race its destroy
+void msg_queue_hold(struct msg_queue* queue);
+void msg_queue_put(struct msg_queue* queue);
+
+// Queue up to count records from 'sender' (returns how many were queued).
+// flags: an overflow policy and a class (MSG_SEND_*); records that are
+// not queued count as dropped. While records wait, the owner runs at no
+// less than the most urgent sender's priority.
+int msg_queue_send(struct msg_queue* queue, uint32_t sender,
+                   const struct msg_vec* vec, uint32_t count, uint32_t flags);
+
+// Capacity bounds (min > 0, min <= max). Returns 0 or -1.
+int msg_queue_set_limits(struct msg_queue* queue, uint32_t min, uint32_t max);
+void msg_queue_get_stats(struct msg_queue* queue, struct msg_queue_stats* out);
+
+// Task 'pid' exited: its sender slot is recycled once the receiver has
+// taken (or dropped) everything it queued. Interrupts disabled.
+void msg_queue_sender_exit(struct msg_queue* queue, uint32_t pid);
+
+// Blocking receive from a queue, see msg_receive_timeout()
+int msg_queue_receive(struct msg_queue* queue, uint32_t receiver, struct message* msg,
+                      uint32_t max_size, uint64_t timeout_ms);
+
+// Allocate/Free message buffers. msg_free() also drops the payload
+// reference of a received MSG_TYPE_SBLOCK message.
 struct message* msg_alloc(size_t data_size);
 void msg_free(struct message* msg);
 
-// Send Message
+// Drop the payload reference of a received message without freeing the
+// buffer (for receive buffers that did not come from msg_alloc())
+void msg_drop_payload(struct message* msg);
+
+// Send Message. A sender PID is the single producer of its channel to
+// each receiver, so only that task may send under its PID. A queue takes
+// up to MSG_SENDERS distinct live senders; further ones fail.
 int msg_send(uint32_t sender, uint32_t receiver, uint32_t type,
              const void* data, uint32_t size);
 
+// msg_send() with an overflow policy (MSG_SEND_*)
+int msg_send_flags(uint32_t sender, uint32_t receiver, uint32_t type,
+                   const void* data, uint32_t size, uint32_t flags);
+
 // Send zero-copy pointer message
 int msg_send_ptr(uint32_t sender, uint32_t receiver, void* ptr, uint32_t size);
 
-// Receive Message (blocking)
+// Send an sblock by handle. The sender's UID must be able to read it.
+// Every queued copy holds its own reference (needs SBLOCK_SHARE);
+// delivery grants the receiver's UID read access and moves the reference
+// into the received message, dropped by msg_free()/msg_drop_payload()
+// (msg_release() for borrowed records). Discarded records drop theirs.
+// The grant outlives the reference: it stays until the block is freed
+// or transferred (see sblock_grant_read()). flags: MSG_SEND_*.
+int msg_send_sblock(uint32_t sender, uint32_t receiver, struct sblock* blk, uint32_t flags);
+
+// Queue up to count messages with one publish and one wakeup.
+// Returns how many were queued (fewer if the channel filled), -1 on error.
+int msg_send_batch(uint32_t sender, uint32_t receiver,
+                   const struct msg_vec* vec, uint32_t count);
+
+// Receive Message (blocking, receiver sleeps in TASK_WAITING_MSG).
+// msg must hold sizeof(struct message) + MSG_MAX_SIZE bytes. The receive,
+// borrow/release and clear calls fail unless 'receiver' is the calling
+// task's own PID.
 int msg_receive(uint32_t receiver, struct message* msg);
 
+// Receive with timeout (0 = forever). Copies at most max_size data bytes.
+// Returns 0, MSG_TIMEOUT, or -1 on error.
+int msg_receive_timeout(uint32_t receiver, struct message* msg,
+                        uint32_t max_size, uint64_t timeout_ms);
+
+// Wait for the first message, then take up to max queued messages into buf
+// (walk them with msg_next()). Returns the count, MSG_TIMEOUT, or -1.
+int msg_receive_many(uint32_t receiver, void* buf, size_t buf_size,
+                     uint32_t max, uint64_t timeout_ms);
+
+// Borrow the next message in place, without copying (blocking, timeout_ms
+// 0 = forever). Its slots stay reserved in the sender's ring until
+// msg_release(), which also drops an sblock handle's reference.
+// Returns NULL on timeout or error.
+const struct msg_record* msg_borrow(uint32_t receiver, uint64_t timeout_ms);
+void msg_release(uint32_t receiver, const struct msg_record* r);
+
 // Check for pending messages
 bool msg_available(uint32_t receiver);
 
@@ -76,4 +279,7 @@ uint32_t msg_count(uint32_t receiver);
 // Clear queue
 void msg_clear(uint32_t receiver);
 
+// Capacity bounds of a task's default queue. Returns 0 or -1.
+int msg_set_limits(uint32_t receiver, uint32_t min, uint32_t max);
+
 #endif // MESSAGES_H
@@ -0,0 +1,504 @@
+/*
+ * paging.c - 4-Level Page Table Manager
+ *
+ * BSD 3-Clause License
+ * Copyright (c) 2025, NeXs Operate System
+ */
+
+#include "paging.h"
+#include "buddy.h"
+#include "libc.h"
+#include "vga.h"
+
+uint64_t* kernel_pml4 = NULL;
+
+// Linker symbol: end of kernel image (upper half address)
+extern char _kernel_end[];
+
+// Early page tables (used until the buddy allocator is running)
+static uint64_t early_tables[PAGING_EARLY_TABLES][512] __attribute__((aligned(4096)));
+static int early_used = 0;
+static bool early_phase = false;
+
+// CPU Features
+static bool has_1g_pages = false;
+static bool has_nx = false;
+static bool has_pge = false;
+static bool has_pcid = false;
+static bool has_invpcid = false;
+
+// PCID Allocation: owner PML4 (physical) per PCID, and PCIDs whose
+// TLB entries may be stale and must be flushed on their next load
+static uint64_t pcid_owner[PAGING_MAX_PCID + 1];
+static uint64_t pcid_stale[(PAGING_MAX_PCID + 64) / 64];
+
+// Statistics
+static uint64_t mapped_bytes = 0;
+static uint32_t count_1g = 0;
+static uint32_t count_2m = 0;
+
+// Walk modes
+#define WALK_LOOKUP 0   // Stop at missing tables or huge pages
+#define WALK_SPLIT  1   // Split huge pages, don't create missing tables
+#define WALK_CREATE 2   // Create missing tables and split huge pages
+
+static uint64_t* alloc_table(void) {
+    uint64_t* table;
+    if (early_phase) {
+        if (early_used >= PAGING_EARLY_TABLES) return NULL;
+        table = early_tables[early_used++];
+    } else {
+        table = page_alloc(0);
+        if (!table) return NULL;
+    }
+    memset(table, 0, PAGE_SIZE);
+    return table;
+}
+
+static inline uint64_t* entry_table(uint64_t entry) {
+    return phys_to_virt(entry & PAGE_ADDR_MASK);
+}
+
+static inline uint64_t table_entry(uint64_t* table) {
+    // Intermediate entries are permissive; leaves carry the real protection
+    return virt_to_phys(table) | PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER;
+}
+
+static inline uint64_t fix_flags(uint64_t flags) {
+    if (!has_nx) flags &= ~PAGE_NX;
+    return flags & PAGE_FLAGS_MASK;
+}
+
+// Kernel-half leaves are global: shared by all spaces, survive CR3 loads
+static inline uint64_t leaf_flags(uint64_t virt, uint64_t flags) {
+    if (has_pge && virt >= PHYS_MAP_BASE) flags |= PAGE_GLOBAL;
+    return fix_flags(flags);
+}
+
+static int pcid_find(uint64_t pml4_phys) {
+    for (int i = 1; i <= PAGING_MAX_PCID; i++) {
+        if (pcid_owner[i] == pml4_phys) return i;
+    }
+    return 0;
+}
+
+static inline void pcid_set_stale(int pcid) {
+    pcid_stale[pcid / 64] |= 1ULL << (pcid % 64);
+}
+
+// Huge page statistics cover the kernel half (direct map, image)
+static inline void count_huge(uint64_t virt, uint64_t size, int delta) {
+    if (virt < PHYS_MAP_BASE) return;
+    if (size == PAGE_SIZE_1G) count_1g += delta;
+    else count_2m += delta;
+}
+
+// Replace a huge entry with a table of 512 next-level entries
+static uint64_t* split_huge(uint64_t* entry, uint64_t virt, uint64_t child_size) {
+    uint64_t* table = alloc_table();
+    if (!table) return NULL;
+
+    uint64_t base = *entry & PAGE_ADDR_MASK;
+    uint64_t flags = *entry & PAGE_FLAGS_MASK;
+
+    // 4KB entries use bit 7 as PAT, so drop PS at the last level
+    if (child_size == PAGE_SIZE) flags &= ~PAGE_HUGE;
+
+    for (int i = 0; i < 512; i++) {
+        table[i] = (base + i * child_size) | flags;
+    }
+
+    if (child_size == PAGE_SIZE_2M) { count_huge(virt, PAGE_SIZE_1G, -1); count_huge(virt, PAGE_SIZE_2M, 512); }
+    else count_huge(virt, PAGE_SIZE_2M, -1);
+
+    *entry = table_entry(table);
+    return table;
+}
+
+// Descend one level, creating or splitting as the mode allows
+static uint64_t* next_level(uint64_t* entry, uint64_t virt, int mode, uint64_t child_size) {
+    if (!(*entry & PAGE_PRESENT)) {
+        if (mode != WALK_CREATE) return NULL;
+        uint64_t* table = alloc_table();
+        if (!table) return NULL;
+        *entry = table_entry(table);
+        return table;
+    }
+    if (*entry & PAGE_HUGE) {
+        if (mode == WALK_LOOKUP) return NULL;
+        return split_huge(entry, virt, child_size);
+    }
+    return entry_table(*entry);
+}
+
+// Return pointer to the 4KB PTE for virt
+static uint64_t* walk(uint64_t* pml4, uint64_t virt, int mode) {
+    uint64_t* pdpt = next_level(&pml4[PML4_INDEX(virt)], virt, mode, 0);
+    if (!pdpt) return NULL;
+    uint64_t* pd = next_level(&pdpt[PDPT_INDEX(virt)], virt, mode, PAGE_SIZE_2M);
+    if (!pd) return NULL;
+    uint64_t* pt = next_level(&pd[PD_INDEX(virt)], virt, mode, PAGE_SIZE);
+    if (!pt) return NULL;
+    return &pt[PT_INDEX(virt)];
+}
+
+// Return pointer to the PD entry for virt (2MB granularity)
+static uint64_t* walk_pd(uint64_t* pml4, uint64_t virt, int mode) {
+    uint64_t* pdpt = next_level(&pml4[PML4_INDEX(virt)], virt, mode, 0);
+    if (!pdpt) return NULL;
+    uint64_t* pd = next_level(&pdpt[PDPT_INDEX(virt)], virt, mode, PAGE_SIZE_2M);
+    if (!pd) return NULL;
+    return &pd[PD_INDEX(virt)];
+}
+
+// True if [virt, virt+2MB) is mapped by one 2MB page and lies within [off, size)
+static bool covers_huge(uint64_t* pml4, uint64_t virt, uint64_t off, size_t size, uint64_t** pde) {
+    if ((virt & (PAGE_SIZE_2M - 1)) || off + PAGE_SIZE_2M > size) return false;
+    *pde = walk_pd(pml4, virt, WALK_LOOKUP);
+    return *pde && (**pde & PAGE_PRESENT) && (**pde & PAGE_HUGE);
+}
+
+// Map one 1GB or 2MB page (used for the physical memory map)
+static int map_large(uint64_t* pml4, uint64_t virt, uint64_t phys,
+                     uint64_t size, uint64_t flags) {
+    uint64_t* pdpt = next_level(&pml4[PML4_INDEX(virt)], virt, WALK_CREATE, 0);
+    if (!pdpt) return -1;
+
+    if (size == PAGE_SIZE_1G) {
+        pdpt[PDPT_INDEX(virt)] = phys | leaf_flags(virt, flags) | PAGE_HUGE;
+    } else {
+        uint64_t* pd = next_level(&pdpt[PDPT_INDEX(virt)], virt, WALK_CREATE, PAGE_SIZE_2M);
+        if (!pd) return -1;
+        pd[PD_INDEX(virt)] = phys | leaf_flags(virt, flags) | PAGE_HUGE;
+    }
+    count_huge(virt, size, 1);
+    return 0;
+}
+
+void paging_flush(uint64_t* pml4, uint64_t virt) {
+    uint64_t phys = virt_to_phys(pml4);
+
+    // Active space, or a global kernel-half entry: INVLPG covers all PCIDs
+    if ((read_cr3() & PAGE_ADDR_MASK) == phys || virt >= PHYS_MAP_BASE) {
+        invlpg(virt);
+        return;
+    }
+    if (!has_pcid) return;
+
+    // Inactive tagged space: its entries outlive the last CR3 switch
+    int pcid = pcid_find(phys);
+    if (!pcid) return;  // Untagged spaces flush on every load
+    if (has_invpcid) invpcid(INVPCID_ADDR, pcid, virt);
+    else pcid_set_stale(pcid);
+}
+
+int paging_map(uint64_t* pml4, uint64_t virt, uint64_t phys, size_t size, uint64_t flags) {
+    if ((virt | phys) & (PAGE_SIZE - 1)) return -1;
+
+    for (uint64_t off = 0; off < size; off += PAGE_SIZE) {
+        uint64_t* pte = walk(pml4, virt + off, WALK_CREATE);
+        if (!pte) return -1;
+
+        bool was_present = *pte & PAGE_PRESENT;
+        *pte = (phys + off) | leaf_flags(virt + off, flags) | PAGE_PRESENT;
+        if (was_present) paging_flush(pml4, virt + off);
+    }
+    return 0;
+}
+
+int paging_unmap(uint64_t* pml4, uint64_t virt, size_t size) {
+    if (virt & (PAGE_SIZE - 1)) return -1;
+
+    for (uint64_t off = 0; off < size; off += PAGE_SIZE) {
+        // Whole 2MB pages are removed without splitting
+        uint64_t* pde;
+        if (covers_huge(pml4, virt + off, off, size, &pde)) {
+            *pde = 0;
+            count_huge(virt + off, PAGE_SIZE_2M, -1);
+            paging_flush(pml4, virt + off);
+            off += PAGE_SIZE_2M - PAGE_SIZE;
+            continue;
+        }
+
+        uint64_t* pte = walk(pml4, virt + off, WALK_SPLIT);
+        if (!pte || !(*pte & PAGE_PRESENT)) continue;
+        *pte = 0;
+        paging_flush(pml4, virt + off);
+    }
+    return 0;
+}
+
+int paging_prepare(uint64_t* pml4, uint64_t virt, size_t size) {
+    if (virt & (PAGE_SIZE - 1)) return -1;
+
+    for (uint64_t off = 0; off < size; off += PAGE_SIZE) {
+        if (!walk(pml4, virt + off, WALK_CREATE)) return -1;
+    }
+    return 0;
+}
+
+int paging_protect(uint64_t* pml4, uint64_t virt, size_t size, uint64_t flags) {
+    if (virt & (PAGE_SIZE - 1)) return -1;
+
+    for (uint64_t off = 0; off < size; off += PAGE_SIZE) {
+        // Whole 2MB pages keep their size
+        uint64_t* pde;
+        if (covers_huge(pml4, virt + off, off, size, &pde)) {
+            *pde = (*pde & PAGE_ADDR_MASK) | leaf_flags(virt + off, flags) | PAGE_PRESENT | PAGE_HUGE;
+            paging_flush(pml4, virt + off);
+            off += PAGE_SIZE_2M - PAGE_SIZE;
+            continue;
+        }
+
+        uint64_t* pte = walk(pml4, virt + off, WALK_SPLIT);
+        if (!pte || !(*pte & PAGE_PRESENT)) return -1;
+        *pte = (*pte & PAGE_ADDR_MASK) | leaf_flags(virt + off, flags) | PAGE_PRESENT;
+        paging_flush(pml4, virt + off);
+    }
+    return 0;
+}
+
+bool paging_translate(uint64_t* pml4, uint64_t virt, uint64_t* phys, uint64_t* flags) {
+    uint64_t e = pml4[PML4_INDEX(virt)];
+    if (!(e & PAGE_PRESENT)) return false;
+
+    e = entry_table(e)[PDPT_INDEX(virt)];
+    if (!(e & PAGE_PRESENT)) return false;
+    uint64_t page_size = PAGE_SIZE_1G;
+
+    if (!(e & PAGE_HUGE)) {
+        e = entry_table(e)[PD_INDEX(virt)];
+        if (!(e & PAGE_PRESENT)) return false;
+        page_size = PAGE_SIZE_2M;
+
+        if (!(e & PAGE_HUGE)) {
+            e = entry_table(e)[PT_INDEX(virt)];
+            if (!(e & PAGE_PRESENT)) return false;
+            page_size = PAGE_SIZE;
+        }
+    }
+
+    if (phys) *phys = (e & PAGE_ADDR_MASK & ~(page_size - 1)) | (virt & (page_size - 1));
+    if (flags) *flags = e & PAGE_FLAGS_MASK;
+    return true;
+}
+
+// Memory the direct map covers write-back: usable, ACPI tables and NVS
+static bool e820_is_ram(const struct e820_entry* e) {
+    return e->type == E820_TYPE_USABLE || e->type == E820_TYPE_ACPI || e->type == E820_TYPE_NVS;
+}
+
+// True if one RAM entry covers all of [base, base+size) ('whole'), or
+// any RAM entry overlaps it
+static bool e820_ram_in(struct e820_entry* entries, int count, uint64_t base, uint64_t size,
+                        bool whole) {
+    for (int i = 0; i < count; i++) {
+        if (!e820_is_ram(&entries[i])) continue;
+        uint64_t start = entries[i].base, end = start + entries[i].length;
+        if (whole ? (start <= base && end >= base + size) : (start < base + size && end > base)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void paging_init(struct e820_entry* entries, int count) {
+    uint32_t a, b, c, d;
+
+    // Detect 1GB pages (EDX bit 26) and NX (EDX bit 20)
+    cpuid(0x80000000, 0, &a, &b, &c, &d);
+    if (a >= 0x80000001) {
+        cpuid(0x80000001, 0, &a, &b, &c, &d);
+        has_1g_pages = (d >> 26) & 1;
+        has_nx = (d >> 20) & 1;
+    }
+
+    if (has_nx) {
+        wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_NXE);
+    }
+
+    // Detect global pages (EDX bit 13), PCID (ECX bit 17), INVPCID (leaf 7 EBX bit 10)
+    cpuid(0, 0, &a, &b, &c, &d);
+    uint32_t max_leaf = a;
+    cpuid(1, 0, &a, &b, &c, &d);
+    has_pge = (d >> 13) & 1;
+    has_pcid = (c >> 17) & 1;
+    if (max_leaf >= 7) {
+        cpuid(7, 0, &a, &b, &c, &d);
+        has_invpcid = (b >> 10) & 1;
+    }
+
+    // Highest RAM address (usable or ACPI), never less than the boot map
+    uint64_t top = 16 * 1024 * 1024;
+    for (int i = 0; i < count; i++) {
+        if (e820_is_ram(&entries[i])) {
+            uint64_t end = entries[i].base + entries[i].length;
+            if (end > top) top = end;
+        }
+    }
+    top = (top + PAGE_SIZE_2M - 1) & ~(PAGE_SIZE_2M - 1);
+
+    early_phase = true;
+    kernel_pml4 = alloc_table();
+
+    // Kernel image: KERNEL_VMA_BASE + [1MB, end of image), 4KB pages up to
+    // 2MB (no write-back alias of the VGA window and ROMs below 1MB), 2MB
+    // pages after. Covers the boot stack below 0x200000 and the early table pool.
+    uint64_t image_end = virt_to_phys(_kernel_end);
+    if (image_end < 0x200000) image_end = 0x200000;
+    paging_map(kernel_pml4, KERNEL_VMA_BASE + 0x100000, 0x100000, 0x100000, PAGE_KERNEL_RW);
+    for (uint64_t addr = PAGE_SIZE_2M; addr < image_end; addr += PAGE_SIZE_2M) {
+        map_large(kernel_pml4, KERNEL_VMA_BASE + addr, addr, PAGE_SIZE_2M, PAGE_KERNEL_RW);
+    }
+
+    // Task stack area: its PDPT must exist before the first space is created
+    next_level(&kernel_pml4[PML4_INDEX(TASK_STACK_AREA)], TASK_STACK_AREA, WALK_CREATE, 0);
+
+    // Direct map, low 2MB in 4KB pages: RAM write-back, the VGA window
+    // uncached, the EBDA and BIOS/option ROMs left unmapped
+    for (uint64_t addr = 0; addr < PAGE_SIZE_2M; addr += PAGE_SIZE) {
+        uint64_t flags = PAGE_KERNEL_RW;
+        if (addr >= VGA_WINDOW_BASE && addr < VGA_WINDOW_END) flags |= PAGE_PCD | PAGE_PWT;
+        else if (!e820_ram_in(entries, count, addr, PAGE_SIZE, false)) continue;
+        paging_map(kernel_pml4, PHYS_MAP_BASE + addr, addr, PAGE_SIZE, flags);
+    }
+
+    // Then PHYS_MAP_BASE + [2MB, top), write-back where there is RAM and
+    // largest page size first: a 1GB page needs one RAM entry covering it,
+    // a 2MB page any RAM in it. Holes (PCI, APIC, firmware) stay unmapped.
+    uint64_t addr = PAGE_SIZE_2M;
+    while (addr < top) {
+        uint64_t size = PAGE_SIZE_2M;
+        if (has_1g_pages && !(addr & (PAGE_SIZE_1G - 1)) && addr + PAGE_SIZE_1G <= top &&
+            e820_ram_in(entries, count, addr, PAGE_SIZE_1G, true)) {
+            size = PAGE_SIZE_1G;
+        }
+        if ((size == PAGE_SIZE_1G || e820_ram_in(entries, count, addr, size, false)) &&
+            map_large(kernel_pml4, PHYS_MAP_BASE + addr, addr, size, PAGE_KERNEL_RW) != 0) {
+            vga_puts("WARN: Early page tables exhausted, memory map truncated\n");
+            break;
+        }
+        addr += size;
+    }
+    mapped_bytes = addr;
+    early_phase = false;
+
+    // Drops the bootloader's identity map: low addresses fault from here on
+    write_cr3(virt_to_phys(kernel_pml4));
+
+    // Tasks run in ring 0: without WP, writes to COW pages would not fault
+    write_cr0(read_cr0() | CR0_WP);
+
+    // PCIDE requires CR3[11:0] == 0, which holds for the kernel PML4
+    if (has_pge) write_cr4(read_cr4() | CR4_PGE);
+    if (has_pcid) write_cr4(read_cr4() | CR4_PCIDE);
+}
+
+bool paging_can_map_2m(uint64_t* pml4, uint64_t virt) {
+    uint64_t* pde = walk_pd(pml4, virt, WALK_LOOKUP);
+    return !pde || !(*pde & PAGE_PRESENT) || (*pde & PAGE_HUGE);
+}
+
+int paging_map_2m(uint64_t* pml4, uint64_t virt, uint64_t phys, uint64_t flags) {
+    if ((virt | phys) & (PAGE_SIZE_2M - 1)) return -1;
+
+    uint64_t* pde = walk_pd(pml4, virt, WALK_CREATE);
+    if (!pde) return -1;
+
+    // A page table below means 4KB pages are mapped: use paging_collapse()
+    bool was_present = *pde & PAGE_PRESENT;
+    if (was_present && !(*pde & PAGE_HUGE)) return -1;
+
+    *pde = phys | leaf_flags(virt, flags) | PAGE_PRESENT | PAGE_HUGE;
+    if (was_present) paging_flush(pml4, virt);
+    else count_huge(virt, PAGE_SIZE_2M, 1);
+    return 0;
+}
+
+int paging_collapse(uint64_t* pml4, uint64_t virt, uint64_t phys, uint64_t flags) {
+    if ((virt | phys) & (PAGE_SIZE_2M - 1)) return -1;
+
+    uint64_t* pde = walk_pd(pml4, virt, WALK_LOOKUP);
+    if (!pde || !(*pde & PAGE_PRESENT) || (*pde & PAGE_HUGE)) return -1;
+
+    uint64_t* pt = entry_table(*pde);
+    *pde = phys | leaf_flags(virt, flags) | PAGE_PRESENT | PAGE_HUGE;
+    count_huge(virt, PAGE_SIZE_2M, 1);
+
+    // Every old 4KB translation may be cached
+    for (uint64_t off = 0; off < PAGE_SIZE_2M; off += PAGE_SIZE) {
+        paging_flush(pml4, virt + off);
+    }
+    page_free(pt, 0);
+    return 0;
+}
+
+uint64_t* paging_create_space(void) {
+    uint64_t* pml4 = alloc_table();
+    if (!pml4) return NULL;
+
+    // Kernel-half PDPTs are shared, so later kernel mappings show up everywhere
+    for (int i = PML4_KERNEL_START; i < 512; i++) {
+        pml4[i] = kernel_pml4[i];
+    }
+
+    if (has_pcid) {
+        int pcid = pcid_find(0);
+        if (pcid) {
+            pcid_owner[pcid] = virt_to_phys(pml4);
+            pcid_set_stale(pcid);   // Previous owner may have left entries
+        }
+    }
+    return pml4;
+}
+
+void paging_destroy_space(uint64_t* pml4) {
+    if (!pml4 || pml4 == kernel_pml4) return;
+
+    int pcid = pcid_find(virt_to_phys(pml4));
+    if (pcid) pcid_owner[pcid] = 0;
+
+    // Free user-half tables; leaf frames belong to the caller
+    for (int i = 0; i < PML4_KERNEL_START; i++) {
+        if (!(pml4[i] & PAGE_PRESENT)) continue;
+        uint64_t* pdpt = entry_table(pml4[i]);
+        for (int j = 0; j < 512; j++) {
+            if (!(pdpt[j] & PAGE_PRESENT) || (pdpt[j] & PAGE_HUGE)) continue;
+            uint64_t* pd = entry_table(pdpt[j]);
+            for (int k = 0; k < 512; k++) {
+                if (!(pd[k] & PAGE_PRESENT) || (pd[k] & PAGE_HUGE)) continue;
+                page_free(entry_table(pd[k]), 0);
+            }
+            page_free(pd, 0);
+        }
+        page_free(pdpt, 0);
+    }
+    page_free(pml4, 0);
+}
+
+uint64_t paging_space_cr3(uint64_t* pml4) {
+    uint64_t phys = virt_to_phys(pml4);
+    return has_pcid ? phys | pcid_find(phys) : phys;
+}
+
+void paging_switch(uint64_t cr3) {
+    uint64_t pcid = cr3 & CR3_PCID_MASK;
+
+    // PCID 0 is shared by untagged spaces: always flush it
+    if (pcid) {
+        uint64_t bit = 1ULL << (pcid % 64);
+        if (pcid_stale[pcid / 64] & bit) pcid_stale[pcid / 64] &= ~bit;
+        else cr3 |= CR3_NOFLUSH;
+    }
+    write_cr3(cr3);
+}
+
+bool paging_pcid_enabled(void) {
+    return has_pcid;
+}
+
+void paging_stats(uint64_t* mapped, uint32_t* pages_1g, uint32_t* pages_2m) {
+    if (mapped) *mapped = mapped_bytes;
+    if (pages_1g) *pages_1g = count_1g;
+    if (pages_2m) *pages_2m = count_2m;
+}
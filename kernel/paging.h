@@ -0,0 +1,196 @@
+/*
+ * paging.h - 4-Level Page Table Manager
+ *
+ * BSD 3-Clause License
+ * Copyright (c) 2025, NeXs Operate System
+ *
+ * Replaces the bootloader's 16MB identity map with a kernel-owned PML4:
+ * - All RAM (per E820) mapped write-back at PHYS_MAP_BASE with 1GB or 2MB
+ *   pages, the VGA window uncached, holes left unmapped
+ * - Kernel image mapped at KERNEL_VMA_BASE (no identity map after boot)
+ * - map/unmap/protect at 4KB granularity (huge pages split on demand)
+ * - Targeted INVLPG flushes for the active address space
+ * - Per-task address spaces sharing the kernel half, PCID-tagged when
+ *   supported so a CR3 switch keeps the other spaces' TLB entries
+ */
+
+#ifndef PAGING_H
+#define PAGING_H
+
+#include "kernel.h"
+
+// Page Sizes
+#define PAGE_SIZE           0x1000ULL       // 4KB
+#define PAGE_SIZE_2M        0x200000ULL     // 2MB
+#define PAGE_SIZE_1G        0x40000000ULL   // 1GB
+
+// Page Table Entry Flags
+#define PAGE_PRESENT        (1ULL << 0)
+#define PAGE_WRITABLE       (1ULL << 1)
+#define PAGE_USER           (1ULL << 2)
+#define PAGE_PWT            (1ULL << 3)
+#define PAGE_PCD            (1ULL << 4)
+#define PAGE_ACCESSED       (1ULL << 5)
+#define PAGE_DIRTY          (1ULL << 6)
+#define PAGE_HUGE           (1ULL << 7)     // PS bit (PDPT/PD level only)
+#define PAGE_GLOBAL         (1ULL << 8)
+#define PAGE_COW            (1ULL << 9)     // Software: shared, copy on write
+#define PAGE_SHARED         (1ULL << 10)    // Software: shared on purpose, never COW
+#define PAGE_NX             (1ULL << 63)    // Ignored if CPU lacks NX
+
+#define PAGE_ADDR_MASK      0x000FFFFFFFFFF000ULL
+#define PAGE_FLAGS_MASK     (~PAGE_ADDR_MASK)
+
+// Common Mappings
+#define PAGE_KERNEL_RW      (PAGE_PRESENT | PAGE_WRITABLE)
+#define PAGE_KERNEL_RO      (PAGE_PRESENT)
+
+// Page Table Indices
+#define PML4_INDEX(v)       (((v) >> 39) & 0x1FF)
+#define PDPT_INDEX(v)       (((v) >> 30) & 0x1FF)
+#define PD_INDEX(v)         (((v) >> 21) & 0x1FF)
+#define PT_INDEX(v)         (((v) >> 12) & 0x1FF)
+
+// Early table pool (BSS): PML4 + PDPT + 2MB-page PDs + the two low 4KB
+// page tables (image, direct map) before the buddy is up
+#define PAGING_EARLY_TABLES 18
+
+// Legacy VGA memory window (direct-mapped uncached)
+#define VGA_WINDOW_BASE     0xA0000ULL
+#define VGA_WINDOW_END      0xC0000ULL
+
+// Kernel half starts at PML4 slot 256 (shared by every address space)
+#define PML4_KERNEL_START   256
+
+// MSRs
+#define MSR_EFER            0xC0000080
+#define EFER_NXE            (1ULL << 11)
+
+// Control Registers
+#define CR0_WP              (1ULL << 16)   // Ring 0 honours read-only pages
+#define CR4_PGE             (1ULL << 7)
+#define CR4_PCIDE           (1ULL << 17)
+#define CR3_PCID_MASK       0xFFFULL
+#define CR3_NOFLUSH         (1ULL << 63)   // Keep TLB entries of the new PCID
+
+// PCIDs 1..PAGING_MAX_PCID are handed out per space, 0 is untagged
+#define PAGING_MAX_PCID     MAX_TASKS
+
+// INVPCID Types
+#define INVPCID_ADDR        0   // One address in one PCID
+#define INVPCID_SINGLE      1   // All non-global entries of one PCID
+
+// =============================================================================
+// Address Translation (kernel image and direct map)
+// =============================================================================
+static inline void* phys_to_virt(uint64_t phys) {
+    return (void*)(phys + PHYS_MAP_BASE);
+}
+
+static inline uint64_t virt_to_phys(const void* virt) {
+    uint64_t v = (uint64_t)virt;
+    if (v >= KERNEL_VMA_BASE) return v - KERNEL_VMA_BASE;
+    return v - PHYS_MAP_BASE;
+}
+
+// =============================================================================
+// CPU Helpers
+// =============================================================================
+static inline uint64_t read_cr3(void) {
+    uint64_t val;
+    asm volatile("mov %%cr3, %0" : "=r"(val));
+    return val;
+}
+
+static inline void write_cr3(uint64_t val) {
+    asm volatile("mov %0, %%cr3" : : "r"(val) : "memory");
+}
+
+static inline void invlpg(uint64_t virt) {
+    asm volatile("invlpg (%0)" : : "r"(virt) : "memory");
+}
+
+static inline uint64_t read_cr0(void) {
+    uint64_t val;
+    asm volatile("mov %%cr0, %0" : "=r"(val));
+    return val;
+}
+
+static inline void write_cr0(uint64_t val) {
+    asm volatile("mov %0, %%cr0" : : "r"(val) : "memory");
+}
+
+static inline uint64_t read_cr4(void) {
+    uint64_t val;
+    asm volatile("mov %%cr4, %0" : "=r"(val));
+    return val;
+}
+
+static inline void write_cr4(uint64_t val) {
+    asm volatile("mov %0, %%cr4" : : "r"(val) : "memory");
+}
+
+static inline void invpcid(uint64_t type, uint64_t pcid, uint64_t virt) {
+    struct { uint64_t pcid; uint64_t addr; } desc = { pcid, virt };
+    asm volatile("invpcid %0, %1" : : "m"(desc), "r"(type) : "memory");
+}
+
+// =============================================================================
+// API
+// =============================================================================
+
+// Kernel address space root (built by paging_init)
+extern uint64_t* kernel_pml4;
+
+// Build kernel PML4 (direct map + kernel image), then load CR3.
+// Must run before buddy_init_e820() touches memory above 16MB.
+void paging_init(struct e820_entry* entries, int count);
+
+// Map [virt, virt+size) -> [phys, phys+size) with 4KB pages
+int paging_map(uint64_t* pml4, uint64_t virt, uint64_t phys, size_t size, uint64_t flags);
+
+// Remove mappings in [virt, virt+size)
+int paging_unmap(uint64_t* pml4, uint64_t virt, size_t size);
+
+// Create the page tables for [virt, virt+size) without mapping anything,
+// so later paging_map() calls there never allocate
+int paging_prepare(uint64_t* pml4, uint64_t virt, size_t size);
+
+// Replace flags of existing mappings in [virt, virt+size)
+int paging_protect(uint64_t* pml4, uint64_t virt, size_t size, uint64_t flags);
+
+// Resolve virtual address. Returns false if not mapped.
+bool paging_translate(uint64_t* pml4, uint64_t virt, uint64_t* phys, uint64_t* flags);
+
+// Invalidate one TLB entry if pml4 is the active address space
+void paging_flush(uint64_t* pml4, uint64_t virt);
+
+// True if a 2MB page can go at virt (no 4KB page table there)
+bool paging_can_map_2m(uint64_t* pml4, uint64_t virt);
+
+// Map one 2MB page (replaces an existing 2MB page, never a page table)
+int paging_map_2m(uint64_t* pml4, uint64_t virt, uint64_t phys, uint64_t flags);
+
+// Replace the 4KB page table at virt by one 2MB page and free the table.
+// The caller owns (and frees) the frames the old table pointed to.
+int paging_collapse(uint64_t* pml4, uint64_t virt, uint64_t phys, uint64_t flags);
+
+// Create an address space: empty user half, kernel half shared
+uint64_t* paging_create_space(void);
+
+// Free a space's user-half page tables and PCID (not the mapped frames)
+void paging_destroy_space(uint64_t* pml4);
+
+// CR3 value for a space (physical PML4 | PCID)
+uint64_t paging_space_cr3(uint64_t* pml4);
+
+// Load CR3, without flushing the TLB when the space is PCID-tagged
+void paging_switch(uint64_t cr3);
+
+// True if CR4.PCIDE is active
+bool paging_pcid_enabled(void);
+
+// Statistics
+void paging_stats(uint64_t* mapped, uint32_t* pages_1g, uint32_t* pages_2m);
+
+#endif // PAGING_H
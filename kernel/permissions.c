@@ -35,11 +35,19 @@
 #include "permissions.h"
 #include "libc.h"
 #include "buddy.h"
+#include "sync.h"
 
 // Global Permission Table (Static Allocation for Reliability)
 static struct task_perms task_perms_table[MAX_TASKS];
 static uint64_t perm_timestamp = 0;
 
+// Checks read the table side by side; changes take it exclusively
+static struct rwlock perm_lock;
+static struct lock_stats perm_lock_stats;
+
+static bool check_locked(uint32_t task_id, uint16_t perm);
+static void inherit_locked(uint32_t child_id, uint32_t parent_id);
+
 // Human-Readable Permission Names (Debug)
 static const char* perm_names[] = {
     "MEMORY_ALLOC",
@@ -65,6 +73,8 @@ static const char* perm_names[] = {
  * Sets up Kernel (Task 0) with full privileges.
  */
 void perm_init(void) {
+    rwlock_init(&perm_lock, &perm_lock_stats, "perms");
+    
     for (int i = 0; i < MAX_TASKS; i++) {
         task_perms_table[i].task_id = i;
         task_perms_table[i].capabilities = PERM_NONE;
@@ -91,13 +101,17 @@ int perm_create_task(uint32_t task_id, uint32_t parent_id, uint16_t initial_perm
         return -1;
     }
     
+    uint64_t flags = write_lock_irqsave(&perm_lock);
+    
     // Security Check: Does parent have right to create tasks?
-    if (!perm_check(parent_id, PERM_TASK_CREATE)) {
+    if (!check_locked(parent_id, PERM_TASK_CREATE)) {
+        write_unlock_irqrestore(&perm_lock, flags);
         return -1; // Access Denied
     }
     
     // Slot Availability Check
     if (task_perms_table[task_id].active) {
+        write_unlock_irqrestore(&perm_lock, flags);
         return -1; // Collision
     }
     
@@ -111,8 +125,9 @@ int perm_create_task(uint32_t task_id, uint32_t parent_id, uint16_t initial_perm
     task_perms_table[task_id].active = true;
     
     // Inheritance Logic
-    perm_inherit(task_id, parent_id);
+    inherit_locked(task_id, parent_id);
     
+    write_unlock_irqrestore(&perm_lock, flags);
     return 0;
 }
 
@@ -124,8 +139,10 @@ void perm_destroy_task(uint32_t task_id) {
         return; // Protection Violation (Cannot kill Kernel)
     }
     
+    uint64_t flags = write_lock_irqsave(&perm_lock);
     task_perms_table[task_id].active = false;
     task_perms_table[task_id].capabilities = PERM_NONE;
+    write_unlock_irqrestore(&perm_lock, flags);
 }
 
 /**
@@ -136,20 +153,19 @@ int perm_grant(uint32_t granter_id, uint32_t target_id, uint16_t perms) {
         return -1;
     }
     
-    // Security Check: Does granter have authority?
-    if (!perm_check(granter_id, PERM_PERM_GRANT)) {
-        return -1; // Access Denied
-    }
+    uint64_t flags = write_lock_irqsave(&perm_lock);
     
-    // Target Existence Check
-    if (!task_perms_table[target_id].active) {
-        return -1;
+    // Security Check: granter needs authority, target must exist
+    if (!check_locked(granter_id, PERM_PERM_GRANT) || !task_perms_table[target_id].active) {
+        write_unlock_irqrestore(&perm_lock, flags);
+        return -1; // Access Denied
     }
     
     // Apply Flags
     task_perms_table[target_id].capabilities |= perms;
     task_perms_table[target_id].granted_time = ++perm_timestamp;
     
+    write_unlock_irqrestore(&perm_lock, flags);
     return 0;
 }
 
@@ -161,17 +177,16 @@ int perm_revoke(uint32_t revoker_id, uint32_t target_id, uint16_t perms) {
         return -1;
     }
     
-    // Security Check
-    if (!perm_check(revoker_id, PERM_PERM_REVOKE)) {
-        return -1;
-    }
-    
     // Kernel Integrity Protection
     if (target_id == 0) {
         return -1; // Cannot revoke capabilities from Kernel
     }
     
-    if (!task_perms_table[target_id].active) {
+    uint64_t flags = write_lock_irqsave(&perm_lock);
+    
+    // Security Check
+    if (!check_locked(revoker_id, PERM_PERM_REVOKE) || !task_perms_table[target_id].active) {
+        write_unlock_irqrestore(&perm_lock, flags);
         return -1;
     }
     
@@ -179,6 +194,7 @@ int perm_revoke(uint32_t revoker_id, uint32_t target_id, uint16_t perms) {
     task_perms_table[target_id].capabilities &= ~perms;
     task_perms_table[target_id].granted_time = ++perm_timestamp;
     
+    write_unlock_irqrestore(&perm_lock, flags);
     return 0;
 }
 
@@ -186,6 +202,13 @@ int perm_revoke(uint32_t revoker_id, uint32_t target_id, uint16_t perms) {
  * Verify Permission
  */
 bool perm_check(uint32_t task_id, uint16_t perm) {
+    uint64_t flags = read_lock_irqsave(&perm_lock);
+    bool ok = check_locked(task_id, perm);
+    read_unlock_irqrestore(&perm_lock, flags);
+    return ok;
+}
+
+static bool check_locked(uint32_t task_id, uint16_t perm) {
     if (task_id >= MAX_TASKS) {
         return false;
     }
@@ -211,11 +234,11 @@ uint16_t perm_get(uint32_t task_id) {
         return PERM_NONE;
     }
     
-    if (!task_perms_table[task_id].active) {
-        return PERM_NONE;
-    }
-    
-    return task_perms_table[task_id].capabilities;
+    uint64_t flags = read_lock_irqsave(&perm_lock);
+    uint16_t caps = task_perms_table[task_id].active ?
+        task_perms_table[task_id].capabilities : PERM_NONE;
+    read_unlock_irqrestore(&perm_lock, flags);
+    return caps;
 }
 
 /**
@@ -223,6 +246,12 @@ uint16_t perm_get(uint32_t task_id) {
  * Automatically called during task creation.
  */
 void perm_inherit(uint32_t child_id, uint32_t parent_id) {
+    uint64_t flags = write_lock_irqsave(&perm_lock);
+    inherit_locked(child_id, parent_id);
+    write_unlock_irqrestore(&perm_lock, flags);
+}
+
+static void inherit_locked(uint32_t child_id, uint32_t parent_id) {
     if (child_id >= MAX_TASKS || parent_id >= MAX_TASKS) {
         return;
     }
@@ -0,0 +1,272 @@
+/*
+ * port.c - Named IPC Ports
+ *
+ * BSD 3-Clause License
+ * Copyright (c) 2025, NeXs Operate System
+ */
+
+#include "port.h"
+#include "process.h"
+#include "permissions.h"
+#include "libc.h"
+
+#define HASH_EMPTY      0
+#define HASH_DELETED    0xFFFF
+
+static struct port ports[PORT_MAX];
+static uint16_t hash_table[PORT_HASH_SIZE];     // Slot + 1, or EMPTY/DELETED
+static struct port* default_ports;
+
+// FNV-1a
+static uint32_t port_hash(const void* key, size_t len) {
+    const uint8_t* p = key;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Default ports are keyed by PID in their own namespace
+static uint32_t task_hash(uint32_t pid) {
+    return port_hash(&pid, sizeof(pid)) ^ 0x80000000u;
+}
+
+static bool port_matches(struct port* p, uint32_t hash, const char* name, uint32_t pid) {
+    if (p->hash != hash) return false;
+    if (name) return !(p->flags & PORT_DEFAULT) && strcmp(p->name, name) == 0;
+    return (p->flags & PORT_DEFAULT) && p->owner == pid;
+}
+
+// Probe for a port by name, or by PID when name is NULL
+static struct port* hash_find(uint32_t hash, const char* name, uint32_t pid) {
+    for (uint32_t i = 0; i < PORT_HASH_SIZE; i++) {
+        uint16_t e = hash_table[(hash + i) & (PORT_HASH_SIZE - 1)];
+        if (e == HASH_EMPTY) return NULL;
+        if (e != HASH_DELETED && port_matches(&ports[e - 1], hash, name, pid)) return &ports[e - 1];
+    }
+    return NULL;
+}
+
+static void hash_insert(struct port* p) {
+    uint16_t slot = (uint16_t)(p - ports) + 1;
+    for (uint32_t i = 0; i < PORT_HASH_SIZE; i++) {
+        uint16_t* e = &hash_table[(p->hash + i) & (PORT_HASH_SIZE - 1)];
+        if (*e == HASH_EMPTY || *e == HASH_DELETED) { *e = slot; return; }
+    }
+}
+
+static void hash_remove(struct port* p) {
+    uint16_t slot = (uint16_t)(p - ports) + 1;
+    for (uint32_t i = 0; i < PORT_HASH_SIZE; i++) {
+        uint16_t* e = &hash_table[(p->hash + i) & (PORT_HASH_SIZE - 1)];
+        if (*e == HASH_EMPTY) return;
+        if (*e == slot) { *e = HASH_DELETED; return; }
+    }
+}
+
+static inline port_t port_handle(struct port* p) {
+    return ((port_t)p->generation << 16) | (uint32_t)(p - ports + 1);
+}
+
+struct port* port_at(int slot) {
+    if (slot < 0 || slot >= PORT_MAX || !ports[slot].used) return NULL;
+    return &ports[slot];
+}
+
+static struct port* port_get(port_t h) {
+    uint32_t slot = (h & 0xFFFF) - 1;
+    if (h == PORT_INVALID || slot >= PORT_MAX) return NULL;
+    struct port* p = &ports[slot];
+    return (p->used && p->generation == (h >> 16)) ? p : NULL;
+}
+
+static struct port* port_alloc(uint32_t owner, uint8_t uid, uint32_t flags) {
+    struct port* p = NULL;
+    for (int i = 0; i < PORT_MAX; i++) {
+        if (!ports[i].used) { p = &ports[i]; break; }
+    }
+    if (!p) return NULL;
+
+    struct msg_queue* q = msg_queue_create(owner);
+    if (!q) return NULL;
+
+    uint16_t gen = p->generation + 1;
+    memset(p, 0, sizeof(*p));
+    p->generation = gen ? gen : 1;
+    p->used = true;
+    p->owner = owner;
+    p->owner_uid = uid;
+    p->flags = (uint8_t)flags;
+    p->queue = q;
+    return p;
+}
+
+// Take a port out of the table; returns its queue for msg_queue_destroy()
+// (interrupts disabled by the caller)
+static struct msg_queue* port_close(struct port* p) {
+    struct msg_queue* q = p->queue;
+    hash_remove(p);
+    if (p->flags & PORT_DEFAULT) {
+        struct port** pp = &default_ports;
+        while (*pp && *pp != p) pp = &(*pp)->next_default;
+        if (*pp) *pp = p->next_default;
+    }
+    p->queue = NULL;
+    p->used = false;
+    return q;
+}
+
+void port_init(void) {
+    memset(ports, 0, sizeof(ports));
+    memset(hash_table, 0, sizeof(hash_table));
+    default_ports = NULL;
+}
+
+// The table, hash chains and default list are only changed with
+// interrupts disabled. Queues found through a handle are held across
+// the send or receive, so a concurrent port_destroy() cannot free them.
+
+port_t port_create(const char* name, uint32_t flags) {
+    struct task* t = current_task;
+    if (!t || !name || !name[0] || strlen(name) >= PORT_NAME_MAX) return PORT_INVALID;
+    if (!(t->perm_mask & PERM_MSG_RECEIVE)) return PORT_INVALID;
+
+    uint32_t hash = port_hash(name, strlen(name));
+    port_t h = PORT_INVALID;
+    uint64_t irq = irq_save();
+    if (!hash_find(hash, name, 0)) {                        // Name free
+        struct port* p = port_alloc(t->pid, t->uid, flags & PORT_PRIVATE);
+        if (p) {
+            strcpy(p->name, name);
+            p->hash = hash;
+            hash_insert(p);
+            h = port_handle(p);
+        }
+    }
+    irq_restore(irq);
+    return h;
+}
+
+int port_destroy(port_t h) {
+    uint64_t irq = irq_save();
+    struct port* p = port_get(h);
+    // Default ports live as long as the PID they are keyed by
+    if (!p || !current_task || p->owner != current_task->pid || (p->flags & PORT_DEFAULT)) {
+        irq_restore(irq);
+        return -1;
+    }
+
+    struct msg_queue* q = port_close(p);
+    irq_restore(irq);
+
+    msg_queue_destroy(q);
+    return 0;
+}
+
+port_t port_lookup(const char* name) {
+    if (!name) return PORT_INVALID;
+    uint64_t irq = irq_save();
+    struct port* p = hash_find(port_hash(name, strlen(name)), name, 0);
+    port_t h = p ? port_handle(p) : PORT_INVALID;
+    irq_restore(irq);
+    return h;
+}
+
+// Queue behind a handle, held (NULL if the handle is stale)
+static struct msg_queue* port_hold(port_t h, struct port* out) {
+    uint64_t irq = irq_save();
+    struct port* p = port_get(h);
+    struct msg_queue* q = p ? p->queue : NULL;
+    if (q) {
+        *out = *p;
+        msg_queue_hold(q);
+    }
+    irq_restore(irq);
+    return q;
+}
+
+int port_send(port_t h, const struct msg_vec* vec, uint32_t count) {
+    struct task* t = current_task;
+    if (!t || !(t->perm_mask & PERM_MSG_SEND)) return -1;
+
+    struct port p;
+    struct msg_queue* q = port_hold(h, &p);
+    if (!q) return -1;
+    int rc = -1;
+    if (!(p.flags & PORT_PRIVATE) || t->uid <= p.owner_uid) {
+        rc = msg_queue_send(q, t->pid, vec, count, MSG_SEND_NONBLOCK);
+    }
+    msg_queue_put(q);
+    return rc;
+}
+
+int port_receive(port_t h, struct message* msg, uint32_t max_size, uint64_t timeout_ms) {
+    if (!current_task) return -1;
+
+    struct port p;
+    struct msg_queue* q = port_hold(h, &p);
+    if (!q) return -1;
+    int rc = -1;
+    if (p.owner == current_task->pid) rc = msg_queue_receive(q, p.owner, msg, max_size, timeout_ms);
+    msg_queue_put(q);
+    return rc;
+}
+
+struct msg_queue* port_task_queue(uint32_t pid, bool create) {
+    uint32_t hash = task_hash(pid);
+    uint64_t irq = irq_save();
+    struct port* p = hash_find(hash, NULL, pid);
+    struct msg_queue* q = p ? p->queue : NULL;
+
+    // Only live tasks get one: a stray PID must not pin a port slot
+    struct task* t = (!p && create) ? task_find(pid) : NULL;
+    if (t && t->state != TASK_TERMINATED) {
+        p = port_alloc(pid, t->uid, PORT_DEFAULT);
+        if (p) {
+            p->hash = hash;
+            hash_insert(p);
+            p->next_default = default_ports;
+            default_ports = p;
+            q = p->queue;
+        }
+    }
+    msg_queue_hold(q);
+    irq_restore(irq);
+    return q;
+}
+
+int port_broadcast(uint32_t sender, const struct msg_vec* v) {
+    // Hold every target first: the list changes as tasks exit
+    struct msg_queue* targets[PORT_MAX];
+    int n = 0;
+    uint64_t irq = irq_save();
+    for (struct port* p = default_ports; p; p = p->next_default) {
+        if (p->owner == sender) continue;
+        msg_queue_hold(p->queue);
+        targets[n++] = p->queue;
+    }
+    irq_restore(irq);
+
+    int success = 0;
+    for (int i = 0; i < n; i++) {
+        if (msg_queue_send(targets[i], sender, v, 1, MSG_SEND_NONBLOCK) == 1) success++;
+        msg_queue_put(targets[i]);
+    }
+    return success > 0 ? 0 : -1;
+}
+
+void port_task_exit(struct task* t) {
+    uint64_t irq = irq_save();
+    for (int i = 0; i < PORT_MAX; i++) {
+        struct port* p = &ports[i];
+        if (!p->used) continue;
+        if (p->owner == t->pid) {
+            msg_queue_destroy(port_close(p));   // Nobody left to receive
+        } else {
+            msg_queue_sender_exit(p->queue, t->pid);
+        }
+    }
+    irq_restore(irq);
+}
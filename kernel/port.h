@@ -0,0 +1,77 @@
+/*
+ * port.h - Named IPC Ports
+ *
+ * BSD 3-Clause License
+ * Copyright (c) 2025, NeXs Operate System
+ *
+ * A port is a message queue with an owner (the only receiver) and a name,
+ * resolved through an FNV-1a hash table. Tasks refer to ports by handle:
+ * slot index plus a generation, so a handle to a destroyed port stays
+ * invalid even after its slot is reused. Every task also has a default
+ * port, keyed by PID, behind the msg_send()/msg_receive() API.
+ */
+
+#ifndef PORT_H
+#define PORT_H
+
+#include "kernel.h"
+#include "messages.h"
+
+#define PORT_MAX            128
+#define PORT_HASH_SIZE      256     // Power of two, 2x PORT_MAX keeps probes short
+#define PORT_NAME_MAX       32
+
+// Handle: generation << 16 | (slot + 1), 0 is never valid
+typedef uint32_t port_t;
+#define PORT_INVALID        0
+
+// Port Flags
+#define PORT_DEFAULT        0x01    // A task's default queue (found by PID)
+#define PORT_PRIVATE        0x02    // Senders need the owner's UID or a lower one
+
+struct port {
+    char     name[PORT_NAME_MAX];
+    uint32_t hash;
+    uint32_t owner;             // PID, the only task allowed to receive
+    uint8_t  owner_uid;
+    uint8_t  flags;
+    uint16_t generation;
+    bool     used;
+    struct msg_queue* queue;
+    struct port* next_default;  // Default ports list (broadcast)
+};
+
+void port_init(void);
+
+// Create a named port owned by the current task
+port_t port_create(const char* name, uint32_t flags);
+
+// Destroy a named port (owner only); queued messages are dropped and
+// blocked senders and receivers fail. Default ports cannot be destroyed:
+// they go, with every other port of the task, in port_task_exit().
+int port_destroy(port_t h);
+
+// Resolve a name (PORT_INVALID if unknown)
+port_t port_lookup(const char* name);
+
+// Send to a port: PERM_MSG_SEND, plus the UID check for PORT_PRIVATE
+int port_send(port_t h, const struct msg_vec* vec, uint32_t count);
+
+// Receive from a port (owner only), see msg_receive_timeout()
+int port_receive(port_t h, struct message* msg, uint32_t max_size, uint64_t timeout_ms);
+
+// Default port queue of a task (created on first use if 'create' and the
+// PID belongs to a live task), held: msg_queue_put() it when done
+struct msg_queue* port_task_queue(uint32_t pid, bool create);
+
+// Queue one message to every default port except the sender's
+int port_broadcast(uint32_t sender, const struct msg_vec* v);
+
+// Task exit: destroy the ports it owns and give up its sender slots
+// in everyone else's queues
+void port_task_exit(struct task* t);
+
+// Port table slot for iteration (NULL if out of range or unused)
+struct port* port_at(int slot);
+
+#endif // PORT_H
@@ -15,6 +15,8 @@
 
 #include "kernel.h"
 
+struct vm_region;
+
 // =============================================================================
 // User Levels (Unix-like UID)
 // =============================================================================
@@ -48,6 +50,22 @@ enum task_state {
 #define QUANTUM_LOW         50
 #define QUANTUM_IDLE        100
 
+// =============================================================================
+// Wait Queue (FIFO of blocked tasks)
+// =============================================================================
+struct task;
+struct wait_queue {
+    struct task* head;
+};
+
+// Priority lent to a task by one source (a mutex it holds, a queue it
+// owns). The task runs at the best of its loans and its own priority.
+struct prio_loan {
+    uint8_t   prio;
+    struct task* to;            // Borrower (NULL: not lent)
+    struct prio_loan* next;     // Borrower's other loans
+};
+
 // =============================================================================
 // Task Control Block (TCB)
 // =============================================================================
@@ -69,6 +87,8 @@ struct task {
     // Scheduling
     uint16_t  quantum;      // Ticks remaining (larger for ms precision)
     uint16_t  base_quantum;
+    uint8_t   base_priority;    // Assigned; 'priority' may be inherited
+    struct prio_loan* loans;    // Outstanding loans (task_lend)
     
     // Timing
     uint64_t  sleep_expiry;
@@ -76,8 +96,20 @@ struct task {
     uint64_t  start_time;   // When task was created
     
     // Resources
-    void*     stack_base;
+    void*     stack_base;   // Lowest stack address (guard page below)
     uint32_t  perm_mask;
+    struct vm_region* regions;  // Demand-paged regions (vmm.c)
+    uint32_t  pages_4k;     // Resident 4KB pages
+    uint32_t  pages_2m;     // Resident 2MB pages
+    
+    // Blocking
+    struct wait_queue* wait_queue;  // Queue we sleep on (NULL if none)
+    struct task* wait_next;
+    
+    // Synchronous IPC (ipc.c)
+    uint8_t   ipc_state;
+    struct task* ipc_partner;       // Callee we wait on / caller we serve
+    struct wait_queue ipc_callers;  // Callers queued until we receive
     
     // Linked List
     struct task* next;
@@ -88,6 +120,7 @@ struct task {
 #define TASK_FLAG_SYSTEM    0x02
 #define TASK_FLAG_BLOCKED   0x04
 #define TASK_FLAG_DAEMON    0x08
+#define TASK_FLAG_TIMEOUT   0x10    // Last wait ended by timeout
 
 // =============================================================================
 // API
@@ -96,12 +129,35 @@ void scheduler_init(void);
 struct task* task_create(void (*entry)(void));
 struct task* task_create_priority(void (*entry)(void), uint8_t priority);
 struct task* task_create_full(void (*entry)(void), uint8_t priority, uint8_t uid);
+struct task* task_clone(void (*entry)(void), uint8_t priority);  // COW share of current task
 void schedule(void);
 void yield(void);
 void sleep(uint64_t ms);
 void exit(void);
+void task_reap(void);   // Free terminated tasks (idle loop, task creation)
+
+// Wait Queues: call wait_queue_sleep() with interrupts disabled (irq_save)
+// around the condition check, so a wakeup cannot slip in between.
+// timeout_ms = 0 waits forever. Returns 0 when woken, -1 on timeout.
+void wait_queue_init(struct wait_queue* wq);
+int wait_queue_sleep(struct wait_queue* wq, uint32_t state, uint64_t timeout_ms);
+struct task* wake_one(struct wait_queue* wq);
+void wake_all(struct wait_queue* wq);
+
+// Raw queue ops (interrupts disabled, no state change)
+void wait_queue_add(struct wait_queue* wq, struct task* t);
+struct task* wait_queue_pop(struct wait_queue* wq);
+void wait_queue_remove(struct wait_queue* wq, struct task* t);
+
+struct task* task_find(uint32_t pid);
 
 void task_set_priority(struct task* t, uint8_t priority);
+
+// Lend t priority p through 'loan' while it serves a more urgent client.
+// A loan moves if it was lent elsewhere; t = NULL or PRIORITY_IDLE returns
+// it. The borrower's priority is recomputed from all its loans, so
+// returning one keeps the others in force.
+void task_lend(struct prio_loan* loan, struct task* t, uint8_t p);
 uint8_t task_get_priority(struct task* t);
 void task_set_uid(struct task* t, uint8_t uid);
 uint8_t task_get_uid(struct task* t);
@@ -109,5 +165,6 @@ uint8_t task_get_uid(struct task* t);
 // Globals
 extern struct task* current_task;
 uint64_t scheduler_switch(uint64_t current_rsp);
+uint64_t scheduler_handoff(uint64_t current_rsp, struct task* to);
 
 #endif // PROCESS_H
@@ -10,47 +10,253 @@
 #include "libc.h"
 #include "process.h"
 
-// Simple CRC32 for signature
-static uint32_t crc32(const void* data, size_t len) {
-    const uint8_t* p = data;
-    uint32_t crc = 0xFFFFFFFF;
-    
-    while (len--) {
-        crc ^= *p++;
-        for (int i = 0; i < 8; i++) {
-            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+// =============================================================================
+// Layout
+// =============================================================================
+// After the header (and the data, for contiguous blocks) one allocation
+// holds the hash tree (2 * width nodes, [0] unused), the dirty bitmap
+// and, for SBLOCK_SG blocks, the segment table.
+
+static inline uint32_t chunk_count(const struct sblock* blk) {
+    return (blk->size + SBLOCK_CHUNK - 1) / SBLOCK_CHUNK;
+}
+
+// Tree width: chunk count rounded up to a power of two
+static inline uint32_t tree_width(uint32_t size) {
+    uint32_t w = 1;
+    while (w * SBLOCK_CHUNK < size) w <<= 1;
+    return w;
+}
+
+static inline uint32_t dirty_words(uint32_t size) {
+    return (size + SBLOCK_CHUNK * 64 - 1) / (SBLOCK_CHUNK * 64);
+}
+
+static size_t meta_size(uint32_t size, bool sg) {
+    uint32_t n = (size + SBLOCK_CHUNK - 1) / SBLOCK_CHUNK;
+    return 2 * tree_width(size) * sizeof(uint32_t) +
+           dirty_words(size) * sizeof(uint64_t) +
+           (sg ? n * sizeof(uint8_t*) : 0);
+}
+
+static inline uint8_t* chunk_ptr(struct sblock* blk, uint32_t c) {
+    return blk->segs ? blk->segs[c] : blk->data + c * SBLOCK_CHUNK;
+}
+
+static inline uint32_t chunk_len(const struct sblock* blk, uint32_t c) {
+    uint32_t off = c * SBLOCK_CHUNK;
+    return (blk->size - off < SBLOCK_CHUNK) ? blk->size - off : SBLOCK_CHUNK;
+}
+
+// =============================================================================
+// Chunk Hash Tree
+// =============================================================================
+static uint32_t chunk_hash(struct sblock* blk, uint32_t c) {
+    return csum(blk->csum_alg, chunk_ptr(blk, c), chunk_len(blk, c));
+}
+
+// Inner node: checksum of its two children, stored side by side
+static inline uint32_t node_hash(struct sblock* blk, uint32_t i) {
+    return csum(blk->csum_alg, &blk->tree[2 * i], 2 * sizeof(uint32_t));
+}
+
+// Rehash every chunk (padding leaves stay 0), then every inner node
+static void tree_build(struct sblock* blk) {
+    uint32_t n = chunk_count(blk);
+    uint32_t leaves = tree_width(blk->size);
+    for (uint32_t c = 0; c < leaves; c++) {
+        blk->tree[leaves + c] = (c < n) ? chunk_hash(blk, c) : 0;
+    }
+    for (uint32_t i = leaves - 1; i >= 1; i--) {
+        blk->tree[i] = node_hash(blk, i);
+    }
+}
+
+// Rehash the dirty chunks and their paths to the root
+static void tree_update(struct sblock* blk) {
+    uint32_t n = chunk_count(blk);
+    uint32_t leaves = tree_width(blk->size);
+    for (uint32_t w = 0; w < dirty_words(blk->size); w++) {
+        uint64_t bits = blk->dirty[w];
+        while (bits) {
+            uint32_t c = w * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            if (c >= n) break;
+            blk->tree[leaves + c] = chunk_hash(blk, c);
+            for (uint32_t i = (leaves + c) / 2; i >= 1; i /= 2) {
+                blk->tree[i] = node_hash(blk, i);
+            }
         }
     }
-    return ~crc;
 }
 
-struct sblock* sblock_alloc(size_t size, uint8_t owner_uid, uint8_t perms) {
-    if (size == 0 || size > 1024 * 1024) return NULL; // 1MB max
+// Chunk c matches its leaf and the leaf's path matches the signature
+static bool tree_check(struct sblock* blk, uint32_t c) {
+    uint32_t leaves = tree_width(blk->size);
+    if (chunk_hash(blk, c) != blk->tree[leaves + c]) return false;
+    for (uint32_t i = (leaves + c) / 2; i >= 1; i /= 2) {
+        if (node_hash(blk, i) != blk->tree[i]) return false;
+    }
+    return blk->tree[1] == blk->signature;
+}
+
+static bool range_ok(const struct sblock* blk, size_t offset, size_t len) {
+    return len > 0 && offset < blk->size && len <= blk->size - offset;
+}
+
+void sblock_mark_dirty(struct sblock* blk, size_t offset, size_t len) {
+    if (!blk || blk->magic != SBLOCK_MAGIC || !range_ok(blk, offset, len)) return;
+    uint32_t last = (offset + len - 1) / SBLOCK_CHUNK;
+    for (uint32_t c = offset / SBLOCK_CHUNK; c <= last; c++) {
+        blk->dirty[c / 64] |= 1ULL << (c % 64);
+    }
+    __atomic_add_fetch(&blk->generation, 1, __ATOMIC_RELEASE);
+}
+
+// =============================================================================
+// Dedup Index
+// =============================================================================
+static struct sblock* dedup_table[SBLOCK_DEDUP_BUCKETS];
+static uint32_t dedup_hits;
+
+static inline uint32_t dedup_bucket(uint32_t signature, uint32_t size) {
+    return (signature ^ (size * 0x9E3779B1u)) % SBLOCK_DEDUP_BUCKETS;
+}
+
+// Take a reference unless the last one is already gone
+static bool ref_tryget(struct sblock* blk) {
+    uint32_t refs = __atomic_load_n(&blk->ref_count, __ATOMIC_RELAXED);
+    do {
+        if (refs == 0 || refs == 0xFFFFFFFF) return false;
+    } while (!__atomic_compare_exchange_n(&blk->ref_count, &refs, refs + 1, true,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    return true;
+}
+
+// Same key and attributes, so a match can stand in for blk
+static bool dedup_match(struct sblock* a, struct sblock* b) {
+    return a->signature == b->signature && a->size == b->size &&
+           a->csum_alg == b->csum_alg && a->owner_uid == b->owner_uid &&
+           a->permissions == b->permissions &&
+           (a->flags & SBLOCK_KERNEL) == (b->flags & SBLOCK_KERNEL);
+}
+
+// Byte comparison, chunk by chunk (contiguous and SG blocks may match)
+static bool same_bytes(struct sblock* a, struct sblock* b) {
+    for (uint32_t c = 0; c < chunk_count(a); c++) {
+        if (memcmp(chunk_ptr(a, c), chunk_ptr(b, c), chunk_len(a, c)) != 0) return false;
+    }
+    return true;
+}
+
+static void dedup_unlink(struct sblock* blk) {
+    uint64_t flags = irq_save();
+    struct sblock** pp = &dedup_table[dedup_bucket(blk->signature, blk->size)];
+    while (*pp && *pp != blk) pp = &(*pp)->dedup_next;
+    if (*pp) *pp = blk->dedup_next;
+    irq_restore(flags);
+}
+
+// =============================================================================
+// Block API
+// =============================================================================
+static bool access_ok(struct sblock* blk, uint8_t uid, uint8_t perm) {
+    if (!blk || blk->magic != SBLOCK_MAGIC) return false;
+    if (!(blk->flags & SBLOCK_VALID)) return false;
+    if ((perm & SBLOCK_WRITE) && (blk->flags & SBLOCK_SEALED)) return false;
+    
+    // Owner has full access
+    if (uid == blk->owner_uid) {
+        return true;
+    }
+    
+    // Kernel bypass
+    if (uid == UID_KERNEL) {
+        return true;
+    }
+    
+    // Check permission (reads may also come from a grant)
+    bool granted = perm == SBLOCK_READ &&
+        (__atomic_load_n(&blk->readers[uid / 64], __ATOMIC_ACQUIRE) & (1ULL << (uid % 64)));
+    if (!(blk->permissions & perm) && !granted) {
+        return false;
+    }
     
-    size_t total = sizeof(struct sblock) + size;
+    // Kernel blocks need root
+    if ((blk->flags & SBLOCK_KERNEL) && uid > UID_ROOT) {
+        return false;
+    }
+    
+    return true;
+}
+
+bool sblock_can_access(struct sblock* blk, uint8_t uid, uint8_t perm) {
+    return access_ok(blk, uid, perm & ~SBLOCK_VERIFY);
+}
+
+// Header and metadata; SBLOCK_SG segments are attached by the caller
+static struct sblock* block_create(size_t size, uint8_t owner_uid, uint8_t perms, bool sg) {
+    size_t head = sizeof(struct sblock) + (sg ? 0 : (size + 7) & ~(size_t)7);
+    size_t total = head + meta_size(size, sg);
     struct sblock* blk = buddy_alloc(total);
     if (!blk) return NULL;
     
     memset(blk, 0, total);
+    blk->tree = (uint32_t*)((uint8_t*)blk + head);
+    blk->dirty = (uint64_t*)(blk->tree + 2 * tree_width(size));
+    if (sg) blk->segs = (uint8_t**)(blk->dirty + dirty_words(size));
     blk->magic = SBLOCK_MAGIC;
     blk->size = size;
     blk->owner_uid = owner_uid;
     blk->permissions = perms;
-    blk->flags = SBLOCK_VALID;
+    blk->flags = SBLOCK_VALID | (sg ? SBLOCK_SG : 0);
     blk->ref_count = 1;
+    blk->generation = 1;        // verified_gen 0: never verified
     blk->signature = 0;
     
     return blk;
 }
 
+static void block_destroy(struct sblock* blk) {
+    if (blk->segs) {
+        // Segments may still be shared with a copy-on-write sibling
+        for (uint32_t c = 0; c < chunk_count(blk); c++) {
+            if (blk->segs[c]) page_ref_put(blk->segs[c], 0);
+        }
+    }
+    blk->magic = 0;  // Invalidate
+    buddy_free(blk);
+}
+
+struct sblock* sblock_alloc(size_t size, uint8_t owner_uid, uint8_t perms) {
+    if (size == 0 || size > SBLOCK_MAX_SIZE) return NULL;
+    return block_create(size, owner_uid, perms, false);
+}
+
+struct sblock* sblock_alloc_sg(size_t size, uint8_t owner_uid, uint8_t perms) {
+    if (size == 0 || size > SBLOCK_SG_MAX_SIZE) return NULL;
+    
+    struct sblock* blk = block_create(size, owner_uid, perms, true);
+    if (!blk) return NULL;
+    
+    // One order-0 page per chunk, no contiguity needed
+    for (uint32_t c = 0; c < chunk_count(blk); c++) {
+        blk->segs[c] = page_alloc(0);
+        if (!blk->segs[c]) {
+            block_destroy(blk);
+            return NULL;
+        }
+        memset(blk->segs[c], 0, SBLOCK_CHUNK);
+    }
+    return blk;
+}
+
 void sblock_free(struct sblock* blk) {
     if (!blk || blk->magic != SBLOCK_MAGIC) return;
     
-    if (blk->ref_count > 0) blk->ref_count--;
-    
-    if (blk->ref_count == 0) {
-        blk->magic = 0;  // Invalidate
-        buddy_free(blk);
+    if (__atomic_sub_fetch(&blk->ref_count, 1, __ATOMIC_ACQ_REL) == 0) {
+        if (blk->flags & SBLOCK_INDEXED) dedup_unlink(blk);
+        block_destroy(blk);
     }
 }
 
@@ -63,50 +269,307 @@ int sblock_share(struct sblock* blk, uint8_t target_uid) {
         return -1;
     }
     
-    // Increment ref count (max 255)
-    if (blk->ref_count < 255) {
-        blk->ref_count++;
-        return 0;
+    return ref_tryget(blk) ? 0 : -1;
+}
+
+int sblock_grant_read(struct sblock* blk, uint8_t target_uid) {
+    if (!blk || blk->magic != SBLOCK_MAGIC) return -1;
+    if ((blk->flags & SBLOCK_KERNEL) && target_uid > UID_ROOT) return -1;
+    
+    __atomic_fetch_or(&blk->readers[target_uid / 64], 1ULL << (target_uid % 64), __ATOMIC_RELEASE);
+    return 0;
+}
+
+int sblock_transfer(struct sblock* blk, uint8_t uid, uint8_t new_owner) {
+    if (!blk || blk->magic != SBLOCK_MAGIC) return -1;
+    if (uid != blk->owner_uid && uid != UID_KERNEL) return -1;
+    
+    // Kernel blocks stay with root or better
+    if ((blk->flags & SBLOCK_KERNEL) && new_owner > UID_ROOT) return -1;
+    if (blk->flags & SBLOCK_INDEXED) return -1;
+    
+    // Grants were made by the old owner's messages: the new one starts clean
+    blk->owner_uid = new_owner;
+    memset(blk->readers, 0, sizeof(blk->readers));
+    return 0;
+}
+
+uint32_t sblock_refs(struct sblock* blk) {
+    if (!blk || blk->magic != SBLOCK_MAGIC) return 0;
+    return __atomic_load_n(&blk->ref_count, __ATOMIC_ACQUIRE);
+}
+
+int sblock_seal(struct sblock** pblk, uint8_t uid, bool dedup) {
+    struct sblock* blk = pblk ? *pblk : NULL;
+    if (!blk || blk->magic != SBLOCK_MAGIC) return -1;
+    if (uid != blk->owner_uid && uid != UID_KERNEL) return -1;
+    
+    if (!(blk->flags & SBLOCK_SEALED)) {
+        sblock_sign(blk);
+        blk->flags |= SBLOCK_SEALED;
+    }
+    if (!dedup || (blk->flags & SBLOCK_INDEXED)) return 0;
+    
+    // First candidate with our key, referenced so it survives the compare
+    uint32_t b = dedup_bucket(blk->signature, blk->size);
+    uint64_t flags = irq_save();
+    struct sblock* match = dedup_table[b];
+    while (match && !(dedup_match(match, blk) && ref_tryget(match))) {
+        match = match->dedup_next;
+    }
+    irq_restore(flags);
+    
+    // Sealed blocks never change, so the compare runs with interrupts on
+    if (match) {
+        if (same_bytes(match, blk)) {
+            __atomic_add_fetch(&dedup_hits, 1, __ATOMIC_RELAXED);
+            sblock_free(blk);
+            *pblk = match;
+            return 0;
+        }
+        sblock_free(match);     // Checksum collision: index both
     }
-    return -1;
+    
+    flags = irq_save();
+    blk->flags |= SBLOCK_INDEXED;
+    blk->dedup_next = dedup_table[b];
+    dedup_table[b] = blk;
+    irq_restore(flags);
+    return 0;
+}
+
+void sblock_dedup_stats(struct sblock_dedup_stats* st) {
+    if (!st) return;
+    memset(st, 0, sizeof(*st));
+    
+    uint64_t flags = irq_save();
+    for (int b = 0; b < SBLOCK_DEDUP_BUCKETS; b++) {
+        for (struct sblock* blk = dedup_table[b]; blk; blk = blk->dedup_next) {
+            st->blocks++;
+            st->stored_bytes += blk->size;
+            st->logical_bytes += (uint64_t)blk->size * sblock_refs(blk);
+        }
+    }
+    irq_restore(flags);
+    
+    st->hits = __atomic_load_n(&dedup_hits, __ATOMIC_RELAXED);
+    st->ratio_x100 = st->stored_bytes ?
+        (uint32_t)(st->logical_bytes * 100 / st->stored_bytes) : 100;
 }
 
 bool sblock_verify(struct sblock* blk) {
     if (!blk || blk->magic != SBLOCK_MAGIC) return false;
     if (!(blk->flags & SBLOCK_VALID)) return false;
     
-    uint32_t computed = crc32(blk->data, blk->size);
-    return computed == blk->signature;
+    if (!(blk->flags & SBLOCK_SIGNED) || blk->csum_alg >= CSUM_ALGS) return false;
+    
+    // Generation before hashing: a write during the walk voids the cache
+    uint32_t gen = __atomic_load_n(&blk->generation, __ATOMIC_ACQUIRE);
+    uint32_t n = chunk_count(blk);
+    uint32_t leaves = tree_width(blk->size);
+    for (uint32_t c = 0; c < n; c++) {
+        if (chunk_hash(blk, c) != blk->tree[leaves + c]) return false;
+    }
+    for (uint32_t i = leaves - 1; i >= 1; i--) {
+        if (node_hash(blk, i) != blk->tree[i]) return false;
+    }
+    if (blk->tree[1] != blk->signature) return false;
+    
+    __atomic_store_n(&blk->verified_gen, gen, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool sblock_verify_cached(struct sblock* blk) {
+    if (!blk || blk->magic != SBLOCK_MAGIC) return false;
+    if (__atomic_load_n(&blk->verified_gen, __ATOMIC_ACQUIRE) ==
+        __atomic_load_n(&blk->generation, __ATOMIC_ACQUIRE)) {
+        return true;
+    }
+    return sblock_verify(blk);
+}
+
+bool sblock_verify_range(struct sblock* blk, size_t offset, size_t len) {
+    if (!blk || blk->magic != SBLOCK_MAGIC) return false;
+    if (!(blk->flags & SBLOCK_VALID) || !(blk->flags & SBLOCK_SIGNED)) return false;
+    if (blk->csum_alg >= CSUM_ALGS || !range_ok(blk, offset, len)) return false;
+    
+    uint32_t last = (offset + len - 1) / SBLOCK_CHUNK;
+    for (uint32_t c = offset / SBLOCK_CHUNK; c <= last; c++) {
+        if (!tree_check(blk, c)) return false;
+    }
+    return true;
 }
 
 void sblock_sign(struct sblock* blk) {
     if (!blk || blk->magic != SBLOCK_MAGIC) return;
-    blk->signature = crc32(blk->data, blk->size);
+    
+    uint8_t alg = csum_default();
+    if ((blk->flags & SBLOCK_SIGNED) && blk->csum_alg == alg) {
+        tree_update(blk);
+    } else {
+        blk->csum_alg = alg;
+        tree_build(blk);
+        blk->flags |= SBLOCK_SIGNED;
+    }
+    memset(blk->dirty, 0, dirty_words(blk->size) * sizeof(uint64_t));
+    blk->signature = blk->tree[1];
+    // New signature, new generation: no verify cached before it vouches for it
+    __atomic_add_fetch(&blk->generation, 1, __ATOMIC_RELEASE);
 }
 
-void* sblock_access(struct sblock* blk, uint8_t uid, uint8_t perm) {
-    if (!blk || blk->magic != SBLOCK_MAGIC) return NULL;
-    if (!(blk->flags & SBLOCK_VALID)) return NULL;
+// Private copy of a shared COW block for a writer: data, signature and
+// tree come along, the writer owns it, and its reference moves over.
+// Scatter-gather segments are shared too, each copied on its first write.
+static struct sblock* sblock_unshare(struct sblock* blk, uint8_t uid) {
+    bool sg = blk->segs != NULL;
+    struct sblock* copy = block_create(blk->size, uid, blk->permissions, sg);
+    if (!copy) return NULL;
     
-    // Owner has full access
-    if (uid == blk->owner_uid) {
-        return blk->data;
+    if (sg) {
+        for (uint32_t c = 0; c < chunk_count(blk); c++) {
+            page_ref_get(blk->segs[c]);
+            copy->segs[c] = blk->segs[c];
+        }
+    } else {
+        memcpy(copy->data, blk->data, blk->size);
     }
+    memcpy(copy->tree, blk->tree, 2 * tree_width(blk->size) * sizeof(uint32_t));
+    memcpy(copy->dirty, blk->dirty, dirty_words(blk->size) * sizeof(uint64_t));
+    copy->signature = blk->signature;
+    copy->csum_alg = blk->csum_alg;
+    copy->flags = blk->flags;
+    copy->generation = blk->generation;     // Same bytes: the cache holds
+    copy->verified_gen = blk->verified_gen;
     
-    // Kernel bypass
-    if (uid == UID_KERNEL) {
-        return blk->data;
+    sblock_free(blk);
+    return copy;
+}
+
+// Checks access; a shared COW block is first replaced by a private copy
+static struct sblock* sblock_for_write(struct sblock** pblk, uint8_t uid) {
+    struct sblock* blk = pblk ? *pblk : NULL;
+    if (!access_ok(blk, uid, SBLOCK_WRITE)) return NULL;
+    
+    if ((blk->permissions & SBLOCK_COW) && sblock_refs(blk) > 1) {
+        blk = sblock_unshare(blk, uid);
+        if (!blk) return NULL;
+        *pblk = blk;
     }
+    return blk;
+}
+
+// Writable chunk c: a segment still shared with a sibling is copied first
+static uint8_t* chunk_for_write(struct sblock* blk, uint32_t c) {
+    if (!blk->segs) return blk->data + c * SBLOCK_CHUNK;
     
-    // Check permission
-    if (!(blk->permissions & perm)) {
-        return NULL;
+    uint8_t* seg = blk->segs[c];
+    if (page_ref_count(seg) > 1) {
+        uint8_t* mine = page_alloc(0);
+        if (!mine) return NULL;
+        memcpy(mine, seg, SBLOCK_CHUNK);
+        page_ref_put(seg, 0);
+        blk->segs[c] = seg = mine;
     }
+    return seg;
+}
+
+void* sblock_write(struct sblock** pblk, uint8_t uid, size_t offset, size_t len) {
+    if (!pblk || !*pblk || !range_ok(*pblk, offset, len)) return NULL;
     
-    // Kernel blocks need root
-    if ((blk->flags & SBLOCK_KERNEL) && uid > UID_ROOT) {
-        return NULL;
+    // Scatter-gather: the range must stay inside one segment
+    uint32_t c = offset / SBLOCK_CHUNK;
+    if ((*pblk)->segs && (offset + len - 1) / SBLOCK_CHUNK != c) return NULL;
+    
+    struct sblock* blk = sblock_for_write(pblk, uid);
+    if (!blk) return NULL;
+    uint8_t* p = chunk_for_write(blk, c);
+    if (!p) return NULL;
+    sblock_mark_dirty(blk, offset, len);
+    return p + offset % SBLOCK_CHUNK;
+}
+
+void* sblock_access(struct sblock** pblk, uint8_t uid, uint8_t perm) {
+    struct sblock* blk = pblk ? *pblk : NULL;
+    if (blk && blk->segs) return NULL;     // No contiguous view
+    bool verify = perm & SBLOCK_VERIFY;
+    perm &= ~SBLOCK_VERIFY;
+    
+    if (!(perm & SBLOCK_WRITE)) {
+        if (!access_ok(blk, uid, perm)) return NULL;
+        return (!verify || sblock_verify_cached(blk)) ? blk->data : NULL;
     }
     
+    // Writer may touch anything: rehash it all on the next sign
+    blk = sblock_for_write(pblk, uid);
+    if (!blk) return NULL;
+    if (verify && !sblock_verify_cached(blk)) return NULL;
+    sblock_mark_dirty(blk, 0, blk->size);
     return blk->data;
 }
+
+// =============================================================================
+// Iteration and Copies
+// =============================================================================
+int sblock_iter_init(struct sblock_iter* it, struct sblock* blk, uint8_t uid,
+                     size_t offset, size_t len) {
+    if (!it || !access_ok(blk, uid, SBLOCK_READ) || !range_ok(blk, offset, len)) return -1;
+    it->blk = blk;
+    it->pos = offset;
+    it->end = offset + len;
+    return 0;
+}
+
+const uint8_t* sblock_iter_next(struct sblock_iter* it, size_t* len) {
+    if (!it || it->pos >= it->end) return NULL;
+    
+    struct sblock* blk = it->blk;
+    const uint8_t* p;
+    size_t n = it->end - it->pos;
+    if (blk->segs) {
+        uint32_t in_seg = SBLOCK_CHUNK - it->pos % SBLOCK_CHUNK;
+        if (n > in_seg) n = in_seg;
+        p = blk->segs[it->pos / SBLOCK_CHUNK] + it->pos % SBLOCK_CHUNK;
+    } else {
+        p = blk->data + it->pos;
+    }
+    it->pos += n;
+    if (len) *len = n;
+    return p;
+}
+
+int sblock_copy_out(struct sblock* blk, uint8_t uid, size_t offset, void* dst, size_t len) {
+    struct sblock_iter it;
+    if (!dst || sblock_iter_init(&it, blk, uid, offset, len) != 0) return -1;
+    
+    uint8_t* out = dst;
+    const uint8_t* p;
+    size_t n;
+    while ((p = sblock_iter_next(&it, &n)) != NULL) {
+        memcpy(out, p, n);
+        out += n;
+    }
+    return 0;
+}
+
+int sblock_copy_in(struct sblock** pblk, uint8_t uid, size_t offset, const void* src, size_t len) {
+    if (!src || !pblk || !*pblk || !range_ok(*pblk, offset, len)) return -1;
+    struct sblock* blk = sblock_for_write(pblk, uid);
+    if (!blk) return -1;
+    
+    const uint8_t* in = src;
+    size_t start = offset, end = offset + len;
+    while (offset < end) {
+        uint32_t c = offset / SBLOCK_CHUNK;
+        size_t n = SBLOCK_CHUNK - offset % SBLOCK_CHUNK;
+        if (n > end - offset) n = end - offset;
+        
+        uint8_t* p = chunk_for_write(blk, c);
+        if (!p) break;      // Out of pages for a private segment
+        memcpy(p + offset % SBLOCK_CHUNK, in, n);
+        in += n;
+        offset += n;
+    }
+    // Whatever was written must be rehashed, even if we stopped early
+    if (offset > start) sblock_mark_dirty(blk, start, offset - start);
+    return offset == end ? 0 : -1;
+}
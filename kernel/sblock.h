@@ -6,45 +6,94 @@
  *
  * Provides secure memory sharing between tasks with:
  * - Signature validation (integrity)
- * - Reference counting (zero-copy)
+ * - Reference counting (zero-copy, atomic)
+ * - Copy-on-write for writers of shared blocks
  * - Permission-based access control
+ * - Scatter-gather blocks of page-sized segments for large payloads
+ * - Content-addressed deduplication of sealed (read-only) blocks
  */
 
 #ifndef SBLOCK_H
 #define SBLOCK_H
 
 #include "kernel.h"
+#include "csum.h"
 
 // Block Permissions
 #define SBLOCK_READ     0x01
 #define SBLOCK_WRITE    0x02
 #define SBLOCK_EXEC     0x04
 #define SBLOCK_SHARE    0x08
+#define SBLOCK_COW      0x10    // Writes to a shared block go to a private copy
+
+// Access Modes (sblock_access() only, never stored)
+#define SBLOCK_VERIFY   0x80    // Verify first, unless already verified
+                                // at the current generation
 
 // Block Flags
 #define SBLOCK_VALID    0x01
 #define SBLOCK_LOCKED   0x02
 #define SBLOCK_KERNEL   0x04
+#define SBLOCK_SIGNED   0x08    // Hash tree is current for csum_alg
+#define SBLOCK_SG       0x10    // Data lives in segs[], one page per chunk
+#define SBLOCK_SEALED   0x20    // Read-only for everyone, owner included
+#define SBLOCK_INDEXED  0x40    // Listed in the dedup index
+
+// Chunked Signing: data is hashed in chunks, and the chunk checksums form
+// a binary hash tree whose root is the signature. Re-signing rehashes
+// only dirty chunks and their paths to the root. A scatter-gather block
+// keeps one page per chunk, so its signature equals that of a contiguous
+// block with the same bytes.
+#define SBLOCK_CHUNK        4096
+#define SBLOCK_MAX_SIZE     0x100000    // 1MB (contiguous)
+#define SBLOCK_SG_MAX_SIZE  0x1000000   // 16MB (scatter-gather)
 
 // Signature Magic
 #define SBLOCK_MAGIC    0x53424C4B5349474Eull  // "SBLKSIGN"
 
 // =============================================================================
-// Signed Block Structure (32 bytes header + data)
+// Signed Block Structure (96 bytes header + data + tree, bitmap, segments)
 // =============================================================================
 struct sblock {
     uint64_t    magic;          // SBLOCK_MAGIC
-    uint32_t    signature;      // CRC32 of data
+    uint32_t    signature;      // Root of the chunk hash tree (csum_alg)
     uint32_t    size;           // Data size in bytes
     
-    uint8_t     owner_uid;      // Creator UID
-    uint8_t     permissions;    // R/W/X/Share
-    uint8_t     flags;          // Valid/Locked/Kernel
-    uint8_t     ref_count;      // Reference counter
+    uint8_t     owner_uid;      // Owner UID (see sblock_transfer)
+    uint8_t     permissions;    // R/W/X/Share/COW
+    uint8_t     flags;          // Valid/Locked/Kernel/Signed
+    uint8_t     csum_alg;       // CSUM_* used by the last sblock_sign()
+    
+    uint32_t    ref_count;      // References (atomic)
+    uint32_t    generation;     // Bumped by every write (atomic, starts at 1)
+    uint32_t    verified_gen;   // Generation of the last good sblock_verify()
     
-    uint32_t    reserved;       // Alignment padding
+    uint32_t*   tree;           // Nodes in heap order: [1] root, then the
+                                // leaves (chunk count rounded up to 2^n)
+    uint64_t*   dirty;          // Chunks written since signing (bitmap)
+    uint8_t**   segs;           // SBLOCK_SG: chunk pages, NULL otherwise
+    struct sblock* dedup_next;  // Dedup index chain (SBLOCK_INDEXED)
+    uint64_t    readers[4];     // UIDs granted SBLOCK_READ (bit per UID)
     
-    uint8_t     data[];         // Flexible array member
+    uint8_t     data[];         // Flexible array member (contiguous only)
+};
+
+// Dedup index: chains hashed by signature and size
+#define SBLOCK_DEDUP_BUCKETS    256
+
+struct sblock_dedup_stats {
+    uint32_t    blocks;         // Indexed (unique) blocks
+    uint32_t    hits;           // Seals answered with an indexed block
+    uint64_t    stored_bytes;   // Data bytes held by indexed blocks
+    uint64_t    logical_bytes;  // Same, counted once per reference
+    uint32_t    ratio_x100;     // logical / stored, in hundredths
+};
+
+// Cursor over a block's bytes, one contiguous piece at a time
+struct sblock_iter {
+    struct sblock*  blk;
+    uint32_t        pos;        // Next byte
+    uint32_t        end;        // One past the last byte
 };
 
 // =============================================================================
@@ -61,13 +110,24 @@ struct sblock {
 struct sblock* sblock_alloc(size_t size, uint8_t owner_uid, uint8_t perms);
 
 /**
- * Free a signed block (decrements ref count)
+ * Allocate a scatter-gather block (up to SBLOCK_SG_MAX_SIZE) built from
+ * order-0 pages. Its data is reached through sblock_iter_*(),
+ * sblock_copy_in/out() or single-segment sblock_write() ranges.
+ * @param size Data size
+ * @param owner_uid Owner's UID
+ * @param perms Initial permissions
+ * @return Pointer to block or NULL on failure
+ */
+struct sblock* sblock_alloc_sg(size_t size, uint8_t owner_uid, uint8_t perms);
+
+/**
+ * Free a signed block (drops one reference, the last one frees it)
  * @param blk Block pointer
  */
 void sblock_free(struct sblock* blk);
 
 /**
- * Share a block with another task (zero-copy)
+ * Share a block with another task (zero-copy, takes a reference)
  * @param blk Block to share
  * @param target_uid Target task UID
  * @return 0 on success, -1 on permission error
@@ -75,25 +135,165 @@ void sblock_free(struct sblock* blk);
 int sblock_share(struct sblock* blk, uint8_t target_uid);
 
 /**
- * Verify block signature
+ * Check a UID against the block's permissions and read grants, by the
+ * same rules as sblock_access() (no pointer, no verification)
+ * @return true if uid may access the block with perm
+ */
+bool sblock_can_access(struct sblock* blk, uint8_t uid, uint8_t perm);
+
+/**
+ * Let one more UID read the block, whatever its permissions say
+ * (used by message delivery). Kernel blocks only go to root or better.
+ * A grant is per UID, not per reference: it lasts until the block is
+ * freed or transferred to a new owner.
+ * @param blk Block
+ * @param target_uid UID to add
+ * @return 0 on success, -1 on permission error
+ */
+int sblock_grant_read(struct sblock* blk, uint8_t target_uid);
+
+/**
+ * Hand ownership to another UID (owner or kernel only); read grants
+ * are cleared
+ * @param blk Block
+ * @param uid Current owner (or UID_KERNEL)
+ * @param new_owner Receiving UID
+ * @return 0 on success, -1 on permission error
+ */
+int sblock_transfer(struct sblock* blk, uint8_t uid, uint8_t new_owner);
+
+/**
+ * Current reference count
+ */
+uint32_t sblock_refs(struct sblock* blk);
+
+/**
+ * Sign a block and make it read-only for good (owner or kernel only).
+ * With dedup, a sealed block of the same owner, permissions and bytes
+ * already in the index replaces *blk (which is freed); otherwise *blk
+ * joins the index. Sealed blocks refuse write access, indexed ones
+ * also refuse transfers (the owner is part of the match).
+ * @param blk Block (may be replaced)
+ * @param uid Owner (or UID_KERNEL)
+ * @param dedup Look up and join the dedup index
+ * @return 0 on success, -1 on permission error
+ */
+int sblock_seal(struct sblock** blk, uint8_t uid, bool dedup);
+
+/**
+ * Dedup index totals
+ * @param st Filled in
+ */
+void sblock_dedup_stats(struct sblock_dedup_stats* st);
+
+/**
+ * Verify block signature (with the algorithm it was signed with)
  * @param blk Block to verify
  * @return true if valid, false if corrupted
  */
 bool sblock_verify(struct sblock* blk);
 
 /**
- * Update block signature after modification
+ * Verify unless the block already verified at its current generation
+ * @param blk Block to verify
+ * @return true if valid, false if corrupted
+ */
+bool sblock_verify_cached(struct sblock* blk);
+
+/**
+ * Verify only the chunks covering a range, and their paths to the root
+ * @param blk Block to verify
+ * @param offset First byte
+ * @param len Range length
+ * @return true if valid, false if corrupted or out of range
+ */
+bool sblock_verify_range(struct sblock* blk, size_t offset, size_t len);
+
+/**
+ * Update block signature after modification (fastest algorithm on this CPU).
+ * Only chunks marked dirty are rehashed once the block has been signed.
+ * Signing clears the dirty marks and bumps the generation, so a cached
+ * verify from before it is dropped.
  * @param blk Block to sign
  */
 void sblock_sign(struct sblock* blk);
 
 /**
- * Get block data pointer (with permission check)
+ * Get a data range for writing and mark its chunks dirty. On a shared
+ * SBLOCK_COW block the caller's reference moves to a private copy,
+ * which replaces *blk. On a scatter-gather block the range must not
+ * cross a segment boundary. The dirty mark covers writes only up to the
+ * next sign or verify: writing through the pointer after that needs
+ * sblock_mark_dirty() first, or the next sign skips the chunks and a
+ * cached verify still vouches for the old bytes.
+ * @param blk Block (may be replaced)
+ * @param uid Requesting UID
+ * @param offset First byte
+ * @param len Range length
+ * @return Pointer to data + offset, NULL on permission denied or bad range
+ */
+void* sblock_write(struct sblock** blk, uint8_t uid, size_t offset, size_t len);
+
+/**
+ * Mark a range as modified and bump the generation (for writers holding
+ * a data pointer: call it again after writing, or a concurrent verifier
+ * may cache a result for data still being changed)
  * @param blk Block
+ * @param offset First byte
+ * @param len Range length
+ */
+void sblock_mark_dirty(struct sblock* blk, size_t offset, size_t len);
+
+/**
+ * Get block data pointer (with permission check). SBLOCK_WRITE access
+ * marks the whole block dirty (use sblock_write() for a range) and, on a
+ * shared SBLOCK_COW block, gives the caller a private copy in *blk; as
+ * with sblock_write(), later writes need sblock_mark_dirty() once the
+ * block has been signed or verified since.
+ * With SBLOCK_VERIFY the block must verify first; the result is cached
+ * until the next write, so read-mostly blocks are hashed once.
+ * @param blk Block (may be replaced)
  * @param uid Requesting UID
- * @param perm Required permission (SBLOCK_READ/WRITE/EXEC)
- * @return Data pointer or NULL on permission denied
+ * @param perm Required permission (SBLOCK_READ/WRITE/EXEC, | SBLOCK_VERIFY)
+ * @return Data pointer or NULL on permission denied, failed verification
+ *         or scatter-gather block
+ */
+void* sblock_access(struct sblock** blk, uint8_t uid, uint8_t perm);
+
+/**
+ * Start iterating over a range (needs SBLOCK_READ)
+ * @param it Iterator
+ * @param blk Block
+ * @param uid Requesting UID
+ * @param offset First byte
+ * @param len Range length
+ * @return 0 on success, -1 on permission denied or bad range
+ */
+int sblock_iter_init(struct sblock_iter* it, struct sblock* blk, uint8_t uid,
+                     size_t offset, size_t len);
+
+/**
+ * Next contiguous piece of the range (a segment or less)
+ * @param it Iterator
+ * @param len Receives the piece length
+ * @return Piece start, NULL when the range is exhausted
+ */
+const uint8_t* sblock_iter_next(struct sblock_iter* it, size_t* len);
+
+/**
+ * Copy a range out of a block (needs SBLOCK_READ)
+ * @return 0 on success, -1 on permission denied or bad range
+ */
+int sblock_copy_out(struct sblock* blk, uint8_t uid, size_t offset, void* dst, size_t len);
+
+/**
+ * Copy into a range and mark it dirty (needs SBLOCK_WRITE, copy-on-write
+ * as sblock_write(); shared segments are copied only where written)
+ * @param blk Block (may be replaced)
+ * @return 0 on success, -1 on permission denied, bad range or no memory
+ *         (a prefix of the range may then hold new data; it is marked
+ *         dirty, so the next sign covers it)
  */
-void* sblock_access(struct sblock* blk, uint8_t uid, uint8_t perm);
+int sblock_copy_in(struct sblock** blk, uint8_t uid, size_t offset, const void* src, size_t len);
 
 #endif // SBLOCK_H
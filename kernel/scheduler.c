@@ -7,20 +7,24 @@
 
 #include "process.h"
 #include "buddy.h"
+#include "paging.h"
+#include "vmm.h"
 #include "libc.h"
 #include "idt.h"
 #include "vga.h"
 #include "handlers.h"
+#include "ipc.h"
+#include "topic.h"
+#include "port.h"
+#include "chan.h"
+#include "sync.h"
 
 // Task Management
 struct task* current_task = NULL;
 static struct task* task_list = NULL;
 static uint32_t next_pid = 0;
-static volatile int sched_lock = 0;
-
-// Stack Protection
-#define STACK_MAGIC 0xDEADCAFEBABEBEEFull
-#define TASK_STACK_SIZE 4096
+static struct spinlock sched_lock;  // Run-queue pass (held from interrupts)
+static struct lock_stats sched_lock_stats;
 
 // Quantum table by priority tier (ms values for 1000Hz timer)
 static const uint16_t quantum_table[8] = {1, 5, 10, 20, 50, 75, 100, 200};
@@ -43,6 +47,8 @@ static void list_add(struct task* t) {
 }
 
 void scheduler_init(void) {
+    spin_init(&sched_lock, &sched_lock_stats, "sched");
+    
     struct task* idle = buddy_alloc(sizeof(struct task));
     if (!idle) PANIC("scheduler_init: alloc failed");
     memset(idle, 0, sizeof(struct task));
@@ -52,36 +58,50 @@ void scheduler_init(void) {
     idle->uid = UID_KERNEL;
     idle->gid = 0;
     idle->priority = PRIORITY_IDLE;
+    idle->base_priority = PRIORITY_IDLE;
     idle->quantum = get_quantum(PRIORITY_IDLE);
     idle->base_quantum = idle->quantum;
     idle->flags = TASK_FLAG_KERNEL;
     idle->perm_mask = 0xFFFFFFFF;
     idle->start_time = get_timer_ticks();
+    idle->cr3 = paging_space_cr3(kernel_pml4);
     
     list_add(idle);
     current_task = idle;
     vga_puts("DEBUG: Scheduler Initialized (PID 0)\n");
 }
 
-struct task* task_create_full(void (*entry)(void), uint8_t priority, uint8_t uid) {
+// Release a task that is not (or no longer) on the run list
+static void task_free(struct task* t) {
+    vmm_destroy(t);
+    paging_destroy_space(task_space(t));
+    buddy_free(t);
+}
+
+// Allocate and set up a task without making it runnable
+static struct task* task_build(void (*entry)(void), uint8_t priority, uint8_t uid) {
     if (!entry) return NULL;
+    task_reap();    // Dead tasks may still hold the stack slots
     
     struct task* t = buddy_alloc(sizeof(struct task));
     if (!t) return NULL;
     memset(t, 0, sizeof(struct task));
     
-    void* stack = buddy_alloc(TASK_STACK_SIZE);
-    if (!stack) { buddy_free(t); return NULL; }
+    // Private address space (user half), kernel half shared
+    uint64_t* pml4 = paging_create_space();
+    if (!pml4) { buddy_free(t); return NULL; }
+    t->cr3 = paging_space_cr3(pml4);
     
-    // Stack canary at bottom
-    ((uint64_t*)stack)[0] = STACK_MAGIC;
+    // Stack above an unmapped guard page
+    uint64_t stack_top = vmm_stack_create(t);
+    if (!stack_top) { task_free(t); return NULL; }
     
-    t->stack_base = stack;
     t->pid = next_pid++;
     t->state = TASK_READY;
     t->uid = uid;
     t->gid = uid;
     t->priority = priority;
+    t->base_priority = priority;
     t->quantum = get_quantum(priority);
     t->base_quantum = t->quantum;
     t->start_time = get_timer_ticks();
@@ -102,7 +122,6 @@ struct task* task_create_full(void (*entry)(void), uint8_t priority, uint8_t uid
     }
     
     // Build interrupt return frame at stack top
-    uint64_t stack_top = (uint64_t)stack + TASK_STACK_SIZE;
     uint64_t* sp = (uint64_t*)stack_top;
     
     *(--sp) = 0x10;
@@ -119,6 +138,28 @@ struct task* task_create_full(void (*entry)(void), uint8_t priority, uint8_t uid
     *(--sp) = 0x10;
     
     t->rsp = (uint64_t)sp;
+    return t;
+}
+
+struct task* task_create_full(void (*entry)(void), uint8_t priority, uint8_t uid) {
+    struct task* t = task_build(entry, priority, uid);
+    if (t) list_add(t);
+    return t;
+}
+
+struct task* task_clone(void (*entry)(void), uint8_t priority) {
+    struct task* parent = current_task;
+    if (!parent) return NULL;
+    
+    struct task* t = task_build(entry, priority, parent->uid);
+    if (!t) return NULL;
+    t->perm_mask = parent->perm_mask;
+    
+    // Child starts at 'entry' on its own stack, seeing the parent's memory
+    if (vmm_clone(parent, t) != 0) {
+        task_free(t);
+        return NULL;
+    }
     list_add(t);
     return t;
 }
@@ -135,6 +176,72 @@ void yield(void) {
     asm volatile("int $32");
 }
 
+void wait_queue_init(struct wait_queue* wq) {
+    wq->head = NULL;
+}
+
+void wait_queue_add(struct wait_queue* wq, struct task* t) {
+    t->wait_next = NULL;
+    struct task** pp = &wq->head;
+    while (*pp) pp = &(*pp)->wait_next;
+    *pp = t;
+}
+
+struct task* wait_queue_pop(struct wait_queue* wq) {
+    struct task* t = wq->head;
+    if (t) {
+        wq->head = t->wait_next;
+        t->wait_next = NULL;
+    }
+    return t;
+}
+
+void wait_queue_remove(struct wait_queue* wq, struct task* t) {
+    struct task** pp = &wq->head;
+    while (*pp && *pp != t) pp = &(*pp)->wait_next;
+    if (*pp) *pp = t->wait_next;
+    t->wait_next = NULL;
+}
+
+// Make a blocked task runnable again
+static void task_wake(struct task* t) {
+    t->wait_queue = NULL;
+    t->wait_next = NULL;
+    t->sleep_expiry = 0;
+    t->state = TASK_READY;
+    t->quantum = t->base_quantum;
+}
+
+int wait_queue_sleep(struct wait_queue* wq, uint32_t state, uint64_t timeout_ms) {
+    struct task* t = current_task;
+    if (!t) return -1;
+    
+    t->state = state;
+    t->sleep_expiry = timeout_ms ? get_timer_ticks() + timeout_ms : 0;
+    t->flags &= ~TASK_FLAG_TIMEOUT;
+    t->wait_queue = wq;
+    wait_queue_add(wq, t);
+    
+    // Not runnable: the scheduler skips us until wake_one() or the timeout
+    yield();
+    return (t->flags & TASK_FLAG_TIMEOUT) ? -1 : 0;
+}
+
+struct task* wake_one(struct wait_queue* wq) {
+    uint64_t flags = irq_save();
+    struct task* t = wait_queue_pop(wq);
+    if (t) task_wake(t);
+    irq_restore(flags);
+    return t;
+}
+
+void wake_all(struct wait_queue* wq) {
+    uint64_t flags = irq_save();
+    struct task* t;
+    while ((t = wait_queue_pop(wq)) != NULL) task_wake(t);
+    irq_restore(flags);
+}
+
 void sleep(uint64_t ms) {
     if (!current_task) return;
     current_task->state = TASK_SLEEPING;
@@ -143,20 +250,11 @@ void sleep(uint64_t ms) {
 }
 
 uint64_t scheduler_switch(uint64_t rsp) {
-    if (!current_task || sched_lock) return rsp;
-    sched_lock = 1;
+    if (!current_task || !spin_trylock(&sched_lock)) return rsp;
     
     current_task->rsp = rsp;
     current_task->cpu_time++;
     
-    // Stack canary check
-    if (current_task->stack_base) {
-        if (((uint64_t*)current_task->stack_base)[0] != STACK_MAGIC) {
-            sched_lock = 0;
-            PANIC("Stack overflow!");
-        }
-    }
-    
     if (current_task->quantum > 0) current_task->quantum--;
     
     // Find next task
@@ -170,6 +268,13 @@ uint64_t scheduler_switch(uint64_t rsp) {
             t->quantum = t->base_quantum;
         }
         
+        // Wait queue timeout
+        if (t->wait_queue && t->sleep_expiry && now >= t->sleep_expiry) {
+            wait_queue_remove(t->wait_queue, t);
+            t->flags |= TASK_FLAG_TIMEOUT;
+            task_wake(t);
+        }
+        
         if (t->state == TASK_READY || t->state == TASK_RUNNING) {
             if (!best || t->priority < best->priority) {
                 best = t;
@@ -181,7 +286,7 @@ uint64_t scheduler_switch(uint64_t rsp) {
     if (current_task->state == TASK_RUNNING && 
         current_task->quantum > 0 &&
         (!best || current_task->priority <= best->priority)) {
-        sched_lock = 0;
+        spin_unlock(&sched_lock);
         return rsp;
     }
     
@@ -191,20 +296,85 @@ uint64_t scheduler_switch(uint64_t rsp) {
         if (current_task->state == TASK_RUNNING)
             current_task->state = TASK_READY;
         
+        // Tagged spaces keep their TLB entries across the switch
+        if (best->cr3 != current_task->cr3) paging_switch(best->cr3);
+        
         current_task = best;
         current_task->state = TASK_RUNNING;
         current_task->quantum = current_task->base_quantum;
     }
     
-    sched_lock = 0;
+    spin_unlock(&sched_lock);
     return current_task->rsp;
 }
 
+// Switch straight to 'to' without a run-queue pass (IPC handoff).
+// The caller has already set current_task's new state.
+uint64_t scheduler_handoff(uint64_t rsp, struct task* to) {
+    current_task->rsp = rsp;
+    if (current_task->state == TASK_RUNNING)
+        current_task->state = TASK_READY;
+    
+    if (to->cr3 != current_task->cr3) paging_switch(to->cr3);
+    
+    current_task = to;
+    to->state = TASK_RUNNING;
+    if (to->quantum == 0) to->quantum = to->base_quantum;
+    return to->rsp;
+}
+
+struct task* task_find(uint32_t pid) {
+    if (!current_task) return NULL;
+    struct task* t = current_task;
+    do {
+        if (t->pid == pid) return t;
+        t = t->next;
+    } while (t != current_task);
+    return NULL;
+}
+
+// Effective priority: own, or the best loan (interrupts disabled)
+static void task_reprioritize(struct task* t) {
+    uint8_t p = t->base_priority;
+    for (struct prio_loan* l = t->loans; l; l = l->next) {
+        if (l->prio < p) p = l->prio;
+    }
+    t->priority = p;
+}
+
 void task_set_priority(struct task* t, uint8_t p) {
     if (t) {
-        t->priority = p;
+        uint64_t flags = irq_save();
+        t->base_priority = p;
         t->base_quantum = get_quantum(p);
+        task_reprioritize(t);
+        irq_restore(flags);
+    }
+}
+
+void task_lend(struct prio_loan* loan, struct task* t, uint8_t p) {
+    if (!loan) return;
+    if (p == PRIORITY_IDLE) t = NULL;
+    
+    uint64_t flags = irq_save();
+    struct task* old = loan->to;
+    if (old && old != t) {
+        struct prio_loan** pp = &old->loans;
+        while (*pp && *pp != loan) pp = &(*pp)->next;
+        if (*pp) *pp = loan->next;
+        loan->to = NULL;
+        task_reprioritize(old);
+    }
+    if (t) {
+        if (loan->to != t) {
+            loan->next = t->loans;
+            t->loans = loan;
+            loan->to = t;
+        }
+        loan->prio = p;
+        task_reprioritize(t);
     }
+    irq_restore(flags);
 }
 
 uint8_t task_get_priority(struct task* t) {
@@ -221,9 +391,47 @@ uint8_t task_get_uid(struct task* t) {
 
 void exit(void) {
     cli();
-    if (current_task) current_task->state = TASK_TERMINATED;
+    if (current_task) {
+        ipc_task_exit(current_task);
+        topic_task_exit(current_task);
+        port_task_exit(current_task);
+        chan_task_exit(current_task);
+        current_task->state = TASK_TERMINATED;
+    }
     yield();
     while(1);
 }
 
+// Unlink one terminated task, interrupts disabled. Never the running task:
+// exit() is still on its stack until the switch away.
+static struct task* task_unlink_dead(void) {
+    struct task* prev = task_list;
+    do {
+        struct task* t = prev->next;
+        if (t->state == TASK_TERMINATED && t != current_task) {
+            prev->next = t->next;
+            if (task_list == t) task_list = t->next;
+            
+            // Loans still pointing here would be unlinked from freed memory
+            for (struct prio_loan* l = t->loans; l; l = l->next) l->to = NULL;
+            t->loans = NULL;
+            return t;
+        }
+        prev = t;
+    } while (prev != task_list);
+    return NULL;
+}
+
+void task_reap(void) {
+    if (!task_list) return;
+    for (;;) {
+        uint64_t flags = irq_save();
+        struct task* t = task_unlink_dead();
+        irq_restore(flags);
+        if (!t) break;
+        task_free(t);
+    }
+    vmm_stack_refill();
+}
+
 void schedule(void) { yield(); }
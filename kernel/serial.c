@@ -34,6 +34,11 @@
 
 #include "serial.h"
 #include "kernel.h"
+#include "sync.h"
+
+// One string at a time on the wire
+static struct spinlock serial_lock;
+static struct lock_stats serial_lock_stats;
 
 #define PORT 0x3f8   // COM1 Base Address
 
@@ -70,15 +75,18 @@ void serial_putc(char a) {
  * Write a string to serial port
  */
 void serial_puts(const char* str) {
+    uint64_t flags = spin_lock_irqsave(&serial_lock);
     while (*str) {
         serial_putc(*str++);
     }
+    spin_unlock_irqrestore(&serial_lock, flags);
 }
 
 /**
  * Initialize Driver
  */
 void serial_init() {
+    spin_init(&serial_lock, &serial_lock_stats, "serial");
     init_serial();
     serial_puts("\n[SERIAL] Serial Port Initialized\n");
 }
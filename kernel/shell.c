@@ -10,12 +10,18 @@
 #include "keyboard.h"
 #include "libc.h"
 #include "buddy.h"
+#include "paging.h"
 #include "messages.h"
 #include "permissions.h"
 #include "process.h"
 #include "handlers.h"
 #include "syscall.h"
 #include "timer.h"
+#include "bench.h"
+#include "vmm.h"
+#include "port.h"
+#include "sblock.h"
+#include "sync.h"
 
 // Integrity Marker
 uint64_t __attribute__((section(".data"))) kernel_end_marker = 0xCAFEBABE12345678;
@@ -42,6 +48,10 @@ static void cmd_sleep(const char* args);
 static void cmd_priority(const char* args);
 static void cmd_reboot(void);
 static void cmd_halt(void);
+static void cmd_vm(void);
+static void cmd_mq(void);
+static void cmd_dedup(void);
+static void cmd_locks(void);
 
 static void print_prompt(void) {
     vga_set_color(VGA_LIGHT_GREEN, VGA_BLACK);
@@ -135,6 +145,11 @@ void shell_execute(const char* cmd) {
     else if (strcmp(cmd_name, "priority") == 0) cmd_priority(args);
     else if (strcmp(cmd_name, "reboot") == 0) cmd_reboot();
     else if (strcmp(cmd_name, "halt") == 0) cmd_halt();
+    else if (strcmp(cmd_name, "bench") == 0) bench_run(args);
+    else if (strcmp(cmd_name, "vm") == 0) cmd_vm();
+    else if (strcmp(cmd_name, "mq") == 0) cmd_mq();
+    else if (strcmp(cmd_name, "dedup") == 0) cmd_dedup();
+    else if (strcmp(cmd_name, "locks") == 0) cmd_locks();
     else if (strcmp(cmd_name, "uid") == 0) {
         vga_puts("Current UID: ");
         vga_puti(current_task ? current_task->uid : 0);
@@ -160,6 +175,10 @@ static void cmd_help(void) {
     vga_puts("  echo <msg>   - Print message\n");
     vga_puts("  mem          - Memory statistics\n");
     vga_puts("  tasks        - List running tasks\n");
+    vga_puts("  vm           - Per-task pages, huge page coverage\n");
+    vga_puts("  mq           - Message queues: depth, drops, wait time\n");
+    vga_puts("  dedup        - Sealed sblock dedup index and ratio\n");
+    vga_puts("  locks        - Lock contention and hold times\n");
     vga_puts("  pid          - Show current PID\n");
     vga_puts("  uptime       - System uptime\n");
     vga_puts("  sleep <ms>   - Sleep for milliseconds\n");
@@ -167,6 +186,7 @@ static void cmd_help(void) {
     vga_puts("  perms [id]   - Show task permissions\n");
     vga_puts("  msg <id>     - Send test message\n");
     vga_puts("  version      - Kernel version\n");
+    vga_puts("  bench [name] - Run microbenchmark\n");
     vga_puts("  reboot       - Reboot system\n");
     vga_puts("  halt         - Halt system\n");
 }
@@ -191,6 +211,19 @@ static void cmd_mem(void) {
     vga_puti(total ? (used * 100) / total : 0); vga_puts("%)\n");
     vga_puts("  Free:  "); vga_puti(free_mem / 1024); vga_puts(" KB (");
     vga_puti(total ? (free_mem * 100) / total : 0); vga_puts("%)\n");
+    
+    uint64_t mapped;
+    uint32_t pages_1g, pages_2m;
+    paging_stats(&mapped, &pages_1g, &pages_2m);
+    vga_puts("  Mapped: "); vga_puti(mapped / (1024 * 1024)); vga_puts(" MB (");
+    vga_puti(pages_1g); vga_puts(" x 1GB, "); vga_puti(pages_2m); vga_puts(" x 2MB)\n");
+    vga_puts("  PCID:  "); vga_puts(paging_pcid_enabled() ? "enabled\n" : "not supported\n");
+    
+    uint64_t faults, demand_pages, cow_breaks;
+    vmm_stats(&faults, &demand_pages, &cow_breaks);
+    vga_puts("  Demand: "); vga_puti((int)demand_pages); vga_puts(" pages, ");
+    vga_puti((int)faults); vga_puts(" faults, ");
+    vga_puti((int)cow_breaks); vga_puts(" COW breaks\n");
 }
 
 static void cmd_tasks(void) {
@@ -205,12 +238,12 @@ static void cmd_tasks(void) {
     
     vga_puts("  PID  STATE     PRIO  CPU\n");
     struct task* t = current_task;
-    const char* states[] = {"READY", "RUNNING", "SLEEPING", "WAITING", "DEAD"};
+    const char* states[] = {"READY", "RUNNING", "SLEEPING", "WAITING", "BLOCKED", "DEAD"};
     do {
         vga_puts("  ");
         vga_puti(t->pid);
         vga_puts("    ");
-        vga_puts(t->state < 5 ? states[t->state] : "???");
+        vga_puts(t->state < 6 ? states[t->state] : "???");
         vga_puts("   ");
         vga_puti(t->priority);
         vga_puts("    ");
@@ -220,6 +253,136 @@ static void cmd_tasks(void) {
     } while (t != current_task);
 }
 
+static void cmd_vm(void) {
+    vga_set_color(VGA_LIGHT_CYAN, VGA_BLACK);
+    vga_puts("Task Memory:\n");
+    vga_set_color(VGA_WHITE, VGA_BLACK);
+    
+    if (!current_task) {
+        vga_puts("  (no tasks)\n");
+        return;
+    }
+    
+    vga_puts("  PID  4KB     2MB   HUGE%\n");
+    struct task* t = current_task;
+    do {
+        uint64_t small = t->pages_4k;
+        uint64_t huge = (uint64_t)t->pages_2m * VMM_HUGE_PAGES;
+        vga_puts("  ");
+        vga_puti(t->pid);
+        vga_puts("    ");
+        vga_puti(t->pages_4k);
+        vga_puts("      ");
+        vga_puti(t->pages_2m);
+        vga_puts("     ");
+        vga_puti((small + huge) ? (int)(huge * 100 / (small + huge)) : 0);
+        vga_puts("%\n");
+        t = t->next;
+    } while (t != current_task);
+    
+    struct vmm_thp_stats thp;
+    vmm_thp_stats(&thp);
+    vga_puts("  THP: "); vga_puti((int)thp.faults); vga_puts(" fault, ");
+    vga_puti((int)thp.collapses); vga_puts(" collapsed, ");
+    vga_puti((int)thp.fallbacks); vga_puts(" fallback\n");
+}
+
+// Print a string left-aligned in a column of 'width' characters
+static void put_col(const char* s, int width) {
+    vga_puts(s);
+    for (int n = (int)strlen(s); n < width; n++) vga_putc(' ');
+}
+
+static void put_num_col(uint32_t v, int width) {
+    char buf[12];
+    uitoa(v, buf, 10);
+    put_col(buf, width);
+}
+
+static void cmd_mq(void) {
+    vga_set_color(VGA_LIGHT_CYAN, VGA_BLACK);
+    vga_puts("Message Queues:\n");
+    vga_set_color(VGA_WHITE, VGA_BLACK);
+    
+    vga_puts("  PORT          QUEUED  CAP   SENT    DROPPED HWM   WAIT(ms)\n");
+    int shown = 0;
+    for (int i = 0; i < PORT_MAX; i++) {
+        struct port* p = port_at(i);
+        if (!p || !p->queue) continue;
+        
+        struct msg_queue_stats st;
+        msg_queue_get_stats(p->queue, &st);
+        vga_puts("  ");
+        if (p->flags & PORT_DEFAULT) {
+            char name[16] = "pid ";
+            uitoa(p->owner, name + 4, 10);
+            put_col(name, 14);
+        } else {
+            put_col(p->name, 14);
+        }
+        put_num_col(st.queued, 8);
+        put_num_col(st.capacity, 6);
+        put_num_col((uint32_t)st.enqueued, 8);
+        put_num_col((uint32_t)st.dropped, 8);
+        put_num_col(st.high_water, 6);
+        put_num_col(st.dequeued ? (uint32_t)(st.wait_total / st.dequeued) : 0, 0);
+        vga_puts("\n");
+        shown++;
+    }
+    if (!shown) vga_puts("  (no queues)\n");
+}
+
+static void cmd_dedup(void) {
+    struct sblock_dedup_stats st;
+    sblock_dedup_stats(&st);
+    
+    vga_set_color(VGA_LIGHT_CYAN, VGA_BLACK);
+    vga_puts("Sblock Dedup:\n");
+    vga_set_color(VGA_WHITE, VGA_BLACK);
+    vga_puts("  Unique blocks: "); vga_puti(st.blocks);
+    vga_puts("  Hits: "); vga_puti(st.hits); vga_puts("\n");
+    vga_puts("  Stored: "); vga_puti((uint32_t)(st.stored_bytes >> 10));
+    vga_puts(" KB  Logical: "); vga_puti((uint32_t)(st.logical_bytes >> 10));
+    vga_puts(" KB\n");
+    vga_puts("  Ratio: "); vga_puti(st.ratio_x100 / 100); vga_putc('.');
+    if (st.ratio_x100 % 100 < 10) vga_putc('0');
+    vga_puti(st.ratio_x100 % 100); vga_puts("x\n");
+}
+
+static void cmd_locks(void) {
+    vga_set_color(VGA_LIGHT_CYAN, VGA_BLACK);
+    vga_puts("Locks:\n");
+    vga_set_color(VGA_WHITE, VGA_BLACK);
+    
+    vga_puts("  NAME        ACQUIRED  CONTEND WAIT/C  HOLD-MAX  HOLD P50\n");
+    int shown = 0;
+    for (struct lock_stats* s = lock_stats_first(); s; s = s->next) {
+        // Median hold: first bucket reaching half of the recorded holds
+        uint64_t holds = 0, seen = 0;
+        uint32_t p50 = 0;
+        for (int b = 0; b < LOCK_HIST_BUCKETS; b++) holds += s->hold_hist[b];
+        for (int b = 0; b < LOCK_HIST_BUCKETS && holds; b++) {
+            seen += s->hold_hist[b];
+            if (seen * 2 >= holds) {
+                p50 = 64u << b;
+                break;
+            }
+        }
+        
+        vga_puts("  ");
+        put_col(s->name ? s->name : "?", 12);
+        put_num_col((uint32_t)s->acquired, 10);
+        put_num_col((uint32_t)s->contended, 8);
+        put_num_col(s->contended ? (uint32_t)(s->wait_cycles / s->contended) : 0, 8);
+        put_num_col((uint32_t)s->hold_max, 10);
+        if (p50) vga_puts("<");
+        put_num_col(p50, 0);
+        vga_puts("\n");
+        shown++;
+    }
+    if (!shown) vga_puts("  (no lock statistics)\n");
+}
+
 static void cmd_pid(void) {
     vga_puts("Current PID: ");
     vga_puti(current_task ? current_task->pid : 0);
@@ -0,0 +1,368 @@
+/*
+ * sync.c - Kernel Synchronization Primitives
+ *
+ * BSD 3-Clause License
+ * Copyright (c) 2025, NeXs Operate System
+ */
+
+#include "sync.h"
+#include "libc.h"
+#include "timer.h"
+
+static inline void cpu_relax(void) {
+    asm volatile("pause" ::: "memory");
+}
+
+// =============================================================================
+// Statistics
+// =============================================================================
+static struct lock_stats* registry;
+static struct spinlock registry_lock;
+
+void lock_stats_register(struct lock_stats* s, const char* name) {
+    if (!s) return;
+
+    uint64_t flags = spin_lock_irqsave(&registry_lock);
+    struct lock_stats* p = registry;
+    while (p && p != s) p = p->next;
+
+    struct lock_stats* next = p ? s->next : registry;
+    memset(s, 0, sizeof(*s));
+    s->name = name;
+    s->next = next;
+    if (!p) registry = s;
+    spin_unlock_irqrestore(&registry_lock, flags);
+}
+
+struct lock_stats* lock_stats_first(void) {
+    return registry;
+}
+
+#if SYNC_STATS
+static inline uint32_t hist_bucket(uint64_t cycles) {
+    if (cycles < 64) return 0;
+    uint32_t b = 63 - __builtin_clzll(cycles) - 5;
+    return b < LOCK_HIST_BUCKETS ? b : LOCK_HIST_BUCKETS - 1;
+}
+
+static inline uint64_t stat_start(struct lock_stats* s) {
+    return s ? rdtsc() : 0;
+}
+
+// Exclusive acquisition (updated under the lock)
+static inline void stat_acquired(struct lock_stats* s, uint64_t* held_at,
+                                 uint64_t start, bool waited) {
+    if (!s) return;
+    uint64_t now = rdtsc();
+    s->acquired++;
+    if (waited) {
+        s->contended++;
+        s->wait_cycles += now - start;
+    }
+    *held_at = now;
+}
+
+static inline void stat_released(struct lock_stats* s, uint64_t held_at) {
+    if (!s) return;
+    uint64_t held = rdtsc() - held_at;
+    if (held > s->hold_max) s->hold_max = held;
+    s->hold_hist[hist_bucket(held)]++;
+}
+
+// Shared acquisition (readers run side by side: counters only)
+static inline void stat_shared(struct lock_stats* s, uint64_t start, bool waited) {
+    if (!s) return;
+    __atomic_add_fetch(&s->acquired, 1, __ATOMIC_RELAXED);
+    if (waited) {
+        __atomic_add_fetch(&s->contended, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&s->wait_cycles, rdtsc() - start, __ATOMIC_RELAXED);
+    }
+}
+#else
+static inline uint64_t stat_start(struct lock_stats* s) { (void)s; return 0; }
+static inline void stat_acquired(struct lock_stats* s, uint64_t* held_at,
+                                 uint64_t start, bool waited) {
+    (void)s; (void)held_at; (void)start; (void)waited;
+}
+static inline void stat_released(struct lock_stats* s, uint64_t held_at) { (void)s; (void)held_at; }
+static inline void stat_shared(struct lock_stats* s, uint64_t start, bool waited) {
+    (void)s; (void)start; (void)waited;
+}
+#endif
+
+static struct lock_stats* stats_attach(struct lock_stats* s, const char* name) {
+    if (!SYNC_STATS || !s) return NULL;
+    lock_stats_register(s, name);
+    return s;
+}
+
+// =============================================================================
+// Ticket Spinlocks
+// =============================================================================
+void spin_init(struct spinlock* l, struct lock_stats* s, const char* name) {
+    l->next = 0;
+    l->owner = 0;
+    l->held_at = 0;
+    l->stats = stats_attach(s, name);
+}
+
+void spin_lock(struct spinlock* l) {
+    uint16_t ticket = __atomic_fetch_add(&l->next, 1, __ATOMIC_RELAXED);
+    if (__atomic_load_n(&l->owner, __ATOMIC_ACQUIRE) == ticket) {
+        stat_acquired(l->stats, &l->held_at, 0, false);
+        return;
+    }
+
+    uint64_t start = stat_start(l->stats);
+    while (__atomic_load_n(&l->owner, __ATOMIC_ACQUIRE) != ticket) cpu_relax();
+    stat_acquired(l->stats, &l->held_at, start, true);
+}
+
+bool spin_trylock(struct spinlock* l) {
+    // Free when the next ticket is the one being served: claim it
+    uint16_t owner = __atomic_load_n(&l->owner, __ATOMIC_ACQUIRE);
+    uint16_t expect = owner;
+    if (!__atomic_compare_exchange_n(&l->next, &expect, (uint16_t)(owner + 1), false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return false;
+    }
+    stat_acquired(l->stats, &l->held_at, 0, false);
+    return true;
+}
+
+void spin_unlock(struct spinlock* l) {
+    stat_released(l->stats, l->held_at);
+    __atomic_store_n(&l->owner, (uint16_t)(l->owner + 1), __ATOMIC_RELEASE);
+}
+
+uint64_t spin_lock_irqsave(struct spinlock* l) {
+    uint64_t flags = irq_save();
+    spin_lock(l);
+    return flags;
+}
+
+void spin_unlock_irqrestore(struct spinlock* l, uint64_t flags) {
+    spin_unlock(l);
+    irq_restore(flags);
+}
+
+// =============================================================================
+// Reader/Writer Locks
+// =============================================================================
+void rwlock_init(struct rwlock* rw, struct lock_stats* s, const char* name) {
+    rw->state = 0;
+    rw->writers = 0;
+    rw->held_at = 0;
+    rw->stats = stats_attach(s, name);
+}
+
+uint64_t read_lock_irqsave(struct rwlock* rw) {
+    uint64_t flags = irq_save();
+    uint64_t start = 0;
+    bool waited = false;
+    for (;;) {
+        int32_t s = __atomic_load_n(&rw->state, __ATOMIC_RELAXED);
+        if (s >= 0 && !__atomic_load_n(&rw->writers, __ATOMIC_RELAXED) &&
+            __atomic_compare_exchange_n(&rw->state, &s, s + 1, true,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+        if (!waited) {
+            waited = true;
+            start = stat_start(rw->stats);
+        }
+        cpu_relax();
+    }
+    stat_shared(rw->stats, start, waited);
+    return flags;
+}
+
+void read_unlock_irqrestore(struct rwlock* rw, uint64_t flags) {
+    __atomic_sub_fetch(&rw->state, 1, __ATOMIC_RELEASE);
+    irq_restore(flags);
+}
+
+uint64_t write_lock_irqsave(struct rwlock* rw) {
+    uint64_t flags = irq_save();
+    __atomic_add_fetch(&rw->writers, 1, __ATOMIC_RELAXED);
+
+    uint64_t start = 0;
+    bool waited = false;
+    int32_t free = 0;
+    while (!__atomic_compare_exchange_n(&rw->state, &free, -1, true,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        free = 0;
+        if (!waited) {
+            waited = true;
+            start = stat_start(rw->stats);
+        }
+        cpu_relax();
+    }
+    __atomic_sub_fetch(&rw->writers, 1, __ATOMIC_RELAXED);
+    stat_acquired(rw->stats, &rw->held_at, start, waited);
+    return flags;
+}
+
+void write_unlock_irqrestore(struct rwlock* rw, uint64_t flags) {
+    stat_released(rw->stats, rw->held_at);
+    __atomic_store_n(&rw->state, 0, __ATOMIC_RELEASE);
+    irq_restore(flags);
+}
+
+// =============================================================================
+// Wait Queues
+// =============================================================================
+int wait_queue_sleep_locked(struct wait_queue* wq, struct spinlock* l,
+                            uint32_t state, uint64_t timeout_ms) {
+    // Interrupts stay off from here to the switch, so no wakeup is lost
+    spin_unlock(l);
+    int r = wait_queue_sleep(wq, state, timeout_ms);
+    cli();
+    spin_lock(l);
+    return r;
+}
+
+// =============================================================================
+// Mutexes
+// =============================================================================
+void mutex_init(struct mutex* m, struct lock_stats* s, const char* name) {
+    spin_init(&m->lock, NULL, NULL);
+    m->locked = 0;
+    m->owner = NULL;
+    memset(&m->loan, 0, sizeof(m->loan));
+    wait_queue_init(&m->waiters);
+    m->held_at = 0;
+    m->stats = stats_attach(s, name);
+}
+
+// Lend the owner the best priority among the waiters (m->lock held)
+static void mutex_boost(struct mutex* m) {
+    uint8_t p = PRIORITY_IDLE;
+    for (struct task* t = m->waiters.head; t; t = t->wait_next) {
+        if (t->priority < p) p = t->priority;
+    }
+    task_lend(&m->loan, m->owner, p);
+}
+
+void mutex_lock(struct mutex* m) {
+    uint64_t flags = spin_lock_irqsave(&m->lock);
+    uint64_t start = 0;
+    bool waited = false;
+    while (m->locked) {
+        if (!waited) {
+            waited = true;
+            start = stat_start(m->stats);
+        }
+        if (!current_task) {
+            // Before the scheduler runs there is nobody to switch to
+            spin_unlock(&m->lock);
+            cpu_relax();
+            spin_lock(&m->lock);
+            continue;
+        }
+
+        // Priority inheritance: the owner runs at no less than our priority.
+        // Recorded even if it already runs better on another loan, which
+        // may be returned while we wait.
+        if (m->owner && (!m->loan.to || current_task->priority < m->loan.prio)) {
+            task_lend(&m->loan, m->owner, current_task->priority);
+        }
+        wait_queue_sleep_locked(&m->waiters, &m->lock, TASK_BLOCKED, 0);
+    }
+
+    m->locked = 1;
+    m->owner = current_task;
+    stat_acquired(m->stats, &m->held_at, start, waited);
+    if (m->waiters.head) mutex_boost(m);    // Others still queued behind us
+    spin_unlock_irqrestore(&m->lock, flags);
+}
+
+bool mutex_trylock(struct mutex* m) {
+    uint64_t flags = spin_lock_irqsave(&m->lock);
+    bool ok = !m->locked;
+    if (ok) {
+        m->locked = 1;
+        m->owner = current_task;
+        stat_acquired(m->stats, &m->held_at, 0, false);
+    }
+    spin_unlock_irqrestore(&m->lock, flags);
+    return ok;
+}
+
+void mutex_unlock(struct mutex* m) {
+    uint64_t flags = spin_lock_irqsave(&m->lock);
+    stat_released(m->stats, m->held_at);
+
+    m->locked = 0;
+    m->owner = NULL;
+    if (m->loan.to) task_lend(&m->loan, NULL, PRIORITY_IDLE);
+    struct task* woken = wake_one(&m->waiters);
+    spin_unlock_irqrestore(&m->lock, flags);
+
+    if (woken && current_task && woken->priority < current_task->priority) {
+        yield();
+    }
+}
+
+// =============================================================================
+// Semaphores
+// =============================================================================
+void sem_init(struct semaphore* s, int32_t count, struct lock_stats* st, const char* name) {
+    spin_init(&s->lock, NULL, NULL);
+    s->count = count;
+    wait_queue_init(&s->waiters);
+    s->stats = stats_attach(st, name);
+}
+
+int sem_down(struct semaphore* s, uint64_t timeout_ms) {
+    uint64_t deadline = timeout_ms ? get_timer_ticks() + timeout_ms : 0;
+    uint64_t flags = spin_lock_irqsave(&s->lock);
+    uint64_t start = 0;
+    bool waited = false;
+    while (s->count <= 0) {
+        if (!waited) {
+            waited = true;
+            start = stat_start(s->stats);
+        }
+        uint64_t left = 0;
+        if (deadline) {
+            uint64_t now = get_timer_ticks();
+            left = (now < deadline) ? deadline - now : 0;
+        }
+        if (!current_task || (deadline && left == 0) ||
+            wait_queue_sleep_locked(&s->waiters, &s->lock, TASK_BLOCKED, left) < 0) {
+            spin_unlock_irqrestore(&s->lock, flags);
+            return -1;
+        }
+    }
+    s->count--;
+
+    // No holder to time: count acquisitions and waits only
+    uint64_t unused;
+    stat_acquired(s->stats, &unused, start, waited);
+    spin_unlock_irqrestore(&s->lock, flags);
+    return 0;
+}
+
+bool sem_trydown(struct semaphore* s) {
+    uint64_t flags = spin_lock_irqsave(&s->lock);
+    bool ok = s->count > 0;
+    if (ok) {
+        s->count--;
+        uint64_t unused;
+        stat_acquired(s->stats, &unused, 0, false);
+    }
+    spin_unlock_irqrestore(&s->lock, flags);
+    return ok;
+}
+
+void sem_up(struct semaphore* s) {
+    uint64_t flags = spin_lock_irqsave(&s->lock);
+    s->count++;
+    struct task* woken = wake_one(&s->waiters);
+    spin_unlock_irqrestore(&s->lock, flags);
+
+    if (woken && current_task && woken->priority < current_task->priority) {
+        yield();
+    }
+}
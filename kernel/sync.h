@@ -0,0 +1,120 @@
+/*
+ * sync.h - Kernel Synchronization Primitives
+ *
+ * BSD 3-Clause License
+ * Copyright (c) 2025, NeXs Operate System
+ *
+ * - Ticket spinlocks (FIFO, IRQ-safe variants)
+ * - Reader/writer spinlocks (waiting writers hold off new readers)
+ * - Sleeping mutexes with priority inheritance
+ * - Counting semaphores
+ * - Sleeping on a wait queue under a spinlock (condition variable style)
+ * Any lock can carry a struct lock_stats: acquisitions, contention, wait
+ * cycles and a log2 histogram of hold times (TSC cycles).
+ */
+
+#ifndef SYNC_H
+#define SYNC_H
+
+#include "kernel.h"
+#include "process.h"
+
+// Build with -DSYNC_STATS=0 to compile the statistics out
+#ifndef SYNC_STATS
+#define SYNC_STATS      1
+#endif
+
+// Hold-time histogram: bucket 0 counts holds under 64 cycles, bucket b
+// holds in [2^(b+5), 2^(b+6)), the last one everything longer
+#define LOCK_HIST_BUCKETS   16
+
+struct lock_stats {
+    const char* name;
+    uint64_t    acquired;
+    uint64_t    contended;      // Acquisitions that had to wait
+    uint64_t    wait_cycles;    // Total cycles spent waiting
+    uint64_t    hold_max;       // Longest hold (cycles)
+    uint32_t    hold_hist[LOCK_HIST_BUCKETS];
+    struct lock_stats* next;    // Registry (lock_stats_register)
+};
+
+// Ticket lock: take a ticket from next, wait until owner reaches it
+struct spinlock {
+    volatile uint16_t next;
+    volatile uint16_t owner;
+    uint64_t    held_at;        // TSC at acquisition (stats only)
+    struct lock_stats* stats;   // Optional
+};
+
+// Reader/writer lock: state > 0 readers, -1 a writer, 0 free
+struct rwlock {
+    volatile int32_t state;
+    volatile uint32_t writers;  // Writers waiting: new readers back off
+    uint64_t    held_at;
+    struct lock_stats* stats;
+};
+
+// Sleeping mutex. While tasks wait, the owner runs at no less than the
+// most urgent waiter's priority; the loan is per mutex, so releasing one
+// lock keeps what other held locks and queues lend the owner.
+struct mutex {
+    struct spinlock lock;       // Guards the fields below
+    uint8_t     locked;
+    struct task* owner;
+    struct prio_loan loan;      // Best waiter's priority, lent to the owner
+    struct wait_queue waiters;
+    uint64_t    held_at;
+    struct lock_stats* stats;
+};
+
+struct semaphore {
+    struct spinlock lock;
+    int32_t     count;
+    struct wait_queue waiters;
+    struct lock_stats* stats;
+};
+
+// Zeroed locks are valid and unlocked; the *_init() calls also attach
+// statistics (NULL for none) and list them in the registry.
+
+// Statistics registry (shell: locks)
+void lock_stats_register(struct lock_stats* s, const char* name);
+struct lock_stats* lock_stats_first(void);
+
+// Spinlocks. The plain variants leave interrupts alone, so use them only
+// on locks never taken from an interrupt handler.
+void spin_init(struct spinlock* l, struct lock_stats* s, const char* name);
+void spin_lock(struct spinlock* l);
+bool spin_trylock(struct spinlock* l);
+void spin_unlock(struct spinlock* l);
+uint64_t spin_lock_irqsave(struct spinlock* l);
+void spin_unlock_irqrestore(struct spinlock* l, uint64_t flags);
+
+// Reader/writer locks (interrupts off while held)
+void rwlock_init(struct rwlock* rw, struct lock_stats* s, const char* name);
+uint64_t read_lock_irqsave(struct rwlock* rw);
+void read_unlock_irqrestore(struct rwlock* rw, uint64_t flags);
+uint64_t write_lock_irqsave(struct rwlock* rw);
+void write_unlock_irqrestore(struct rwlock* rw, uint64_t flags);
+
+// Mutexes (task context only: lock may sleep)
+void mutex_init(struct mutex* m, struct lock_stats* s, const char* name);
+void mutex_lock(struct mutex* m);
+bool mutex_trylock(struct mutex* m);
+void mutex_unlock(struct mutex* m);
+
+// Semaphores. sem_down() timeout_ms = 0 waits forever; returns 0, or -1
+// on timeout.
+void sem_init(struct semaphore* s, int32_t count, struct lock_stats* st, const char* name);
+int sem_down(struct semaphore* s, uint64_t timeout_ms);
+bool sem_trydown(struct semaphore* s);
+void sem_up(struct semaphore* s);
+
+// Sleep on wq with l released, retaking it before returning. Call with l
+// held through spin_lock_irqsave(): a wakeup issued under l after the
+// caller's condition check cannot be missed. Same results as
+// wait_queue_sleep().
+int wait_queue_sleep_locked(struct wait_queue* wq, struct spinlock* l,
+                            uint32_t state, uint64_t timeout_ms);
+
+#endif // SYNC_H
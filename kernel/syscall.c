@@ -15,6 +15,10 @@
 #include "handlers.h"
 #include "buddy.h"
 #include "timer.h"
+#include "ipc.h"
+#include "port.h"
+#include "libc.h"
+#include "topic.h"
 
 /*
  * Syscall Table
@@ -28,6 +32,15 @@
 #define SYS_SLEEP       35
 #define SYS_MSGSND      71
 #define SYS_MSGRCV      72
+#define SYS_IPC_CALL    73  // Synchronous call (ipc.c)
+#define SYS_IPC_REPLY_WAIT 74
+#define SYS_MSGSND_BATCH 75 // Vector of messages, one wakeup
+#define SYS_MSGRCV_MANY 76
+#define SYS_PORT_CREATE 77  // Named ports (port.c)
+#define SYS_PORT_DESTROY 78
+#define SYS_PORT_LOOKUP 79
+#define SYS_PORT_SEND   80
+#define SYS_PORT_RECV   81
 #define SYS_UPTIME      96
 #define SYS_MEMINFO     97
 #define SYS_TASKINFO    98
@@ -85,10 +98,51 @@ static int64_t sys_msgsnd(uint32_t dest, uint32_t type, uint64_t data) {
     return msg_send(current_task->pid, dest, type, &data, sizeof(data));
 }
 
-static int64_t sys_msgrcv(uint32_t task_id) {
+// Block on own queue. buf holds a struct message plus max_size data bytes.
+// Returns the message data size, MSG_TIMEOUT, or -1.
+static int64_t sys_msgrcv(struct message* buf, uint32_t max_size, uint64_t timeout_ms) {
+    if (!current_task || !buf) return -1;
+    if (!(current_task->perm_mask & PERM_MSG_RECEIVE)) return -1;
+    int r = msg_receive_timeout(current_task->pid, buf, max_size, timeout_ms);
+    return r < 0 ? r : (int64_t)buf->size;
+}
+
+static int64_t sys_msgsnd_batch(uint32_t dest, const struct msg_vec* vec, uint32_t count) {
+    if (!current_task) return -1;
+    if (!(current_task->perm_mask & PERM_MSG_SEND)) return -1;
+    return msg_send_batch(current_task->pid, dest, vec, count);
+}
+
+// Fill buf with as many queued messages as fit (blocks for the first)
+static int64_t sys_msgrcv_many(void* buf, size_t size, uint64_t timeout_ms) {
     if (!current_task) return -1;
     if (!(current_task->perm_mask & PERM_MSG_RECEIVE)) return -1;
-    return msg_available(task_id) ? 1 : 0;
+    return msg_receive_many(current_task->pid, buf, size, 0xFFFFFFFF, timeout_ms);
+}
+
+// Subscribe without a filter callback (those run in the publisher)
+static int64_t sys_topic_subscribe(int id, uint32_t types, uint32_t policy) {
+    return topic_subscribe(id, types, NULL, NULL, policy);
+}
+
+static int64_t sys_topic_publish(int id, const struct msg_vec* v) {
+    if (!v || msg_by_ref(v->type)) return -1;
+    return topic_publish(id, v->type, v->data, v->size);
+}
+
+// Copy the next topic message out (blocking) and drop the reference.
+// buf holds a struct message plus max_size data bytes. Returns the
+// message data size, or -1.
+static int64_t sys_topic_recv(int id, struct message* buf, uint32_t max_size) {
+    if (!buf) return -1;
+    const struct message* m = topic_receive(id, 0);
+    if (!m) return -1;
+    
+    uint32_t copy = m->size < max_size ? m->size : max_size;
+    memcpy(buf, m, sizeof(struct message) + copy);
+    if (copy < m->size) buf->flags |= MSG_FLAG_TRUNCATED;
+    topic_release(m);
+    return (int64_t)buf->size;
 }
 
 static int64_t sys_taskinfo(uint32_t pid, uint32_t* state, uint8_t* priority) {
@@ -117,9 +171,7 @@ static int64_t sys_getfreq(void) {
 /*
  * Main Dispatcher
  */
-void syscall_handler(struct interrupt_frame* frame) {
-    if (!frame) return;
-    
+uint64_t syscall_handler(struct interrupt_frame* frame) {
     uint64_t num = frame->rax;
     uint64_t a1 = frame->rdi;
     uint64_t a2 = frame->rsi;
@@ -127,6 +179,10 @@ void syscall_handler(struct interrupt_frame* frame) {
     
     int64_t ret = -1;
     
+    // IPC fast path: may switch tasks, results land in the frames directly
+    if (num == SYS_IPC_CALL) return ipc_sys_call(frame);
+    if (num == SYS_IPC_REPLY_WAIT) return ipc_sys_reply_wait(frame);
+    
     switch (num) {
         case SYS_READ:      ret = sys_read((int)a1, (char*)a2, (size_t)a3); break;
         case SYS_WRITE:     ret = sys_write((int)a1, (const char*)a2, (size_t)a3); break;
@@ -137,7 +193,19 @@ void syscall_handler(struct interrupt_frame* frame) {
         case SYS_SLEEP:     ret = sys_sleep(a1); break;
         case SYS_EXIT:      sys_exit((int)a1); break;
         case SYS_MSGSND:    ret = sys_msgsnd((uint32_t)a1, (uint32_t)a2, a3); break;
-        case SYS_MSGRCV:    ret = sys_msgrcv((uint32_t)a1); break;
+        case SYS_MSGRCV:    ret = sys_msgrcv((struct message*)a1, (uint32_t)a2, a3); break;
+        case SYS_MSGSND_BATCH: ret = sys_msgsnd_batch((uint32_t)a1, (const struct msg_vec*)a2, (uint32_t)a3); break;
+        case SYS_MSGRCV_MANY:  ret = sys_msgrcv_many((void*)a1, (size_t)a2, a3); break;
+        case SYS_PORT_CREATE:  ret = port_create((const char*)a1, (uint32_t)a2); break;
+        case SYS_PORT_DESTROY: ret = port_destroy((port_t)a1); break;
+        case SYS_PORT_LOOKUP:  ret = port_lookup((const char*)a1); break;
+        case SYS_PORT_SEND:    ret = port_send((port_t)a1, (const struct msg_vec*)a2, (uint32_t)a3); break;
+        case SYS_PORT_RECV:    ret = port_receive((port_t)a1, (struct message*)a2, (uint32_t)a3, 0); break;
+        case SYS_TOPIC_CREATE: ret = topic_create((const char*)a1); break;
+        case SYS_TOPIC_SUBSCRIBE:   ret = sys_topic_subscribe((int)a1, (uint32_t)a2, (uint32_t)a3); break;
+        case SYS_TOPIC_UNSUBSCRIBE: ret = topic_unsubscribe((int)a1); break;
+        case SYS_TOPIC_PUBLISH: ret = sys_topic_publish((int)a1, (const struct msg_vec*)a2); break;
+        case SYS_TOPIC_RECV:   ret = sys_topic_recv((int)a1, (struct message*)a2, (uint32_t)a3); break;
         case SYS_TASKINFO:  ret = sys_taskinfo((uint32_t)a1, (uint32_t*)a2, (uint8_t*)a3); break;
         case SYS_GETTIME_NS:ret = sys_gettime_ns(); break;
         case SYS_GETFREQ:   ret = sys_getfreq(); break;
@@ -145,6 +213,7 @@ void syscall_handler(struct interrupt_frame* frame) {
     }
     
     frame->rax = (uint64_t)ret;
+    return (uint64_t)frame;
 }
 
 void syscall_init(void) {
@@ -20,6 +20,20 @@
 #define SYS_EXIT        60
 #define SYS_MSGSND      71
 #define SYS_MSGRCV      72
+#define SYS_IPC_CALL    73
+#define SYS_IPC_REPLY_WAIT 74
+#define SYS_MSGSND_BATCH 75
+#define SYS_MSGRCV_MANY 76
+#define SYS_PORT_CREATE 77
+#define SYS_PORT_DESTROY 78
+#define SYS_PORT_LOOKUP 79
+#define SYS_PORT_SEND   80
+#define SYS_PORT_RECV   81
+#define SYS_TOPIC_CREATE 82
+#define SYS_TOPIC_SUBSCRIBE 83
+#define SYS_TOPIC_UNSUBSCRIBE 84
+#define SYS_TOPIC_PUBLISH 85
+#define SYS_TOPIC_RECV  86
 #define SYS_UPTIME      96
 #define SYS_MEMINFO     97
 #define SYS_TASKINFO    98
@@ -27,8 +41,8 @@
 // Init
 void syscall_init(void);
 
-// Handler
-void syscall_handler(struct interrupt_frame* frame);
+// Handler: returns the RSP to resume (a different task after an IPC handoff)
+uint64_t syscall_handler(struct interrupt_frame* frame);
 
 // POSIX Wrappers
 ssize_t write(int fd, const void* buf, size_t n);
@@ -0,0 +1,185 @@
+/*
+ * topic.c - Publish/Subscribe Topics
+ *
+ * BSD 3-Clause License
+ * Copyright (c) 2025, NeXs Operate System
+ */
+
+#include "topic.h"
+#include "buddy.h"
+#include "libc.h"
+#include "permissions.h"
+#include "handlers.h"
+
+static struct topic* topics[TOPIC_MAX];
+
+static struct topic* topic_get(int id) {
+    return (id >= 0 && id < TOPIC_MAX) ? topics[id] : NULL;
+}
+
+static struct topic_sub* topic_sub_of(struct topic* t, uint32_t pid) {
+    for (int i = 0; i < TOPIC_MAX_SUBS; i++) {
+        if (t->subs[i].used && t->subs[i].pid == pid) return &t->subs[i];
+    }
+    return NULL;
+}
+
+static void buf_put(struct topic_buf* b) {
+    if (__atomic_sub_fetch(&b->refs, 1, __ATOMIC_ACQ_REL) == 0) buddy_free(b);
+}
+
+int topic_find(const char* name) {
+    if (!name) return -1;
+    for (int i = 0; i < TOPIC_MAX; i++) {
+        if (topics[i] && strcmp(topics[i]->name, name) == 0) return i;
+    }
+    return -1;
+}
+
+int topic_create(const char* name) {
+    if (!name || !name[0] || strlen(name) >= TOPIC_NAME_MAX) return -1;
+    int id = topic_find(name);
+    if (id >= 0) return id;
+
+    for (id = 0; id < TOPIC_MAX && topics[id]; id++) {}
+    if (id == TOPIC_MAX) return -1;
+
+    struct topic* t = buddy_alloc(sizeof(struct topic));
+    if (!t) return -1;
+    memset(t, 0, sizeof(struct topic));
+    t->used = true;
+    strcpy(t->name, name);
+    topics[id] = t;
+    return id;
+}
+
+// Drop a subscription and the references still queued on it
+static void sub_remove(struct topic_sub* s) {
+    while (s->head != s->tail) buf_put(s->queue[s->tail++ % TOPIC_DEPTH]);
+    s->used = false;
+    wake_all(&s->readers);
+    wake_all(&s->writers);
+}
+
+// A subscriber that has exited will never make room
+static bool sub_alive(struct topic_sub* s) {
+    struct task* t = task_find(s->pid);
+    return t && t->state != TASK_TERMINATED;
+}
+
+int topic_subscribe(int id, uint32_t types, topic_filter_t filter, void* ctx, uint32_t policy) {
+    struct topic* t = topic_get(id);
+    struct task* me = current_task;
+    if (!t || !me || !(me->perm_mask & PERM_MSG_RECEIVE) || policy > TOPIC_POLICY_BLOCK) return -1;
+    if (topic_sub_of(t, me->pid)) return -1;
+
+    for (int i = 0; i < TOPIC_MAX_SUBS; i++) {
+        struct topic_sub* s = &t->subs[i];
+        if (s->used) continue;
+        memset(s, 0, sizeof(*s));
+        s->used = true;
+        s->pid = me->pid;
+        s->types = types;
+        s->filter = filter;
+        s->ctx = ctx;
+        s->policy = policy;
+        return 0;
+    }
+    return -1;
+}
+
+int topic_unsubscribe(int id) {
+    struct topic* t = topic_get(id);
+    struct topic_sub* s = (t && current_task) ? topic_sub_of(t, current_task->pid) : NULL;
+    if (!s) return -1;
+
+    uint64_t flags = irq_save();
+    sub_remove(s);
+    irq_restore(flags);
+    return 0;
+}
+
+void topic_task_exit(struct task* t) {
+    uint64_t flags = irq_save();
+    for (int i = 0; i < TOPIC_MAX; i++) {
+        struct topic_sub* s = topics[i] ? topic_sub_of(topics[i], t->pid) : NULL;
+        if (s) sub_remove(s);
+    }
+    irq_restore(flags);
+}
+
+int topic_publish(int id, uint32_t type, const void* data, uint32_t size) {
+    struct topic* t = topic_get(id);
+    struct task* me = current_task;
+    if (!t || !me || !(me->perm_mask & PERM_MSG_SEND) || size > MSG_MAX_SIZE) return -1;
+
+    // The only copy of the payload
+    struct topic_buf* b = buddy_alloc(sizeof(struct topic_buf) + size);
+    if (!b) return -1;
+    b->refs = 1;    // Publisher's, dropped below
+    b->msg.sender_id = me->pid;
+    b->msg.receiver_id = 0;
+    b->msg.type = type;
+    b->msg.size = size;
+    b->msg.slab_class = 0;
+    b->msg.flags = 0;
+    b->msg.timestamp = get_timer_ticks();
+    if (data && size) memcpy(b->msg.data, data, size);
+
+    int delivered = 0;
+    uint64_t flags = irq_save();
+    for (int i = 0; i < TOPIC_MAX_SUBS; i++) {
+        struct topic_sub* s = &t->subs[i];
+        if (!s->used || s->pid == me->pid) continue;
+        if (type < 32 && !(s->types & (1U << type))) continue;
+        if (s->filter && !s->filter(&b->msg, s->ctx)) continue;
+
+        while (s->used && s->head - s->tail == TOPIC_DEPTH) {
+            if (s->policy == TOPIC_POLICY_BLOCK && sub_alive(s)) {
+                wait_queue_sleep(&s->writers, TASK_BLOCKED, 0);
+                continue;
+            }
+            // Evicted, or a blocking subscriber that is gone
+            if (s->policy != TOPIC_POLICY_DROP) sub_remove(s);
+            break;
+        }
+        if (!s->used || s->head - s->tail == TOPIC_DEPTH) {
+            s->dropped++;
+            continue;
+        }
+
+        __atomic_add_fetch(&b->refs, 1, __ATOMIC_RELAXED);
+        s->queue[s->head++ % TOPIC_DEPTH] = b;
+        s->delivered++;
+        delivered++;
+        wake_one(&s->readers);
+    }
+    t->published++;
+    irq_restore(flags);
+
+    buf_put(b);
+    return delivered;
+}
+
+const struct message* topic_receive(int id, uint64_t timeout_ms) {
+    struct topic* t = topic_get(id);
+    struct topic_sub* s = (t && current_task) ? topic_sub_of(t, current_task->pid) : NULL;
+    if (!s) return NULL;
+
+    uint64_t flags = irq_save();
+    while (s->used && s->head == s->tail) {
+        if (wait_queue_sleep(&s->readers, TASK_WAITING_MSG, timeout_ms) < 0) break;
+    }
+    struct topic_buf* b = NULL;
+    if (s->used && s->head != s->tail) {
+        b = s->queue[s->tail++ % TOPIC_DEPTH];
+        wake_one(&s->writers);
+    }
+    irq_restore(flags);
+    return b ? &b->msg : NULL;
+}
+
+void topic_release(const struct message* msg) {
+    if (!msg) return;
+    buf_put((struct topic_buf*)((uint8_t*)msg - __builtin_offsetof(struct topic_buf, msg)));
+}
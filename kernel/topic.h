@@ -0,0 +1,85 @@
+/*
+ * topic.h - Publish/Subscribe Topics
+ *
+ * BSD 3-Clause License
+ * Copyright (c) 2025, NeXs Operate System
+ *
+ * A published payload is copied once into a refcounted buffer; each
+ * matching subscriber queue holds a reference to it. Subscribers read the
+ * shared buffer in place and drop their reference with topic_release().
+ * A subscriber whose queue is full is handled by its policy: the message
+ * is dropped for it, it is unsubscribed, or the publisher waits.
+ */
+
+#ifndef TOPIC_H
+#define TOPIC_H
+
+#include "kernel.h"
+#include "messages.h"
+#include "process.h"
+
+#define TOPIC_MAX           16
+#define TOPIC_NAME_MAX      32
+#define TOPIC_MAX_SUBS      MAX_TASKS
+#define TOPIC_DEPTH         16          // Queued references per subscriber
+
+// Slow Subscriber Policies
+#define TOPIC_POLICY_DROP   0           // Skip this message for the subscriber
+#define TOPIC_POLICY_EVICT  1           // Unsubscribe it
+#define TOPIC_POLICY_BLOCK  2           // Publisher waits for queue space
+
+// Per-subscriber filter: type bitmask (bit n = message type n), then an
+// optional callback run in the publisher's context
+#define TOPIC_TYPES_ALL     0xFFFFFFFF
+typedef bool (*topic_filter_t)(const struct message* msg, void* ctx);
+
+// Shared payload: one per publish, freed when the last reference drops
+struct topic_buf {
+    uint32_t refs;
+    uint32_t pad;
+    struct message msg;     // Must be last (flexible data)
+};
+
+struct topic_sub {
+    bool     used;
+    uint32_t pid;
+    uint32_t types;
+    topic_filter_t filter;
+    void*    ctx;
+    uint32_t policy;
+    struct topic_buf* queue[TOPIC_DEPTH];
+    uint32_t head, tail;        // Free-running, head - tail = queued
+    uint64_t delivered;
+    uint64_t dropped;
+    struct wait_queue readers;  // Subscriber waiting for a message
+    struct wait_queue writers;  // Publishers waiting for space (BLOCK)
+};
+
+struct topic {
+    bool     used;
+    char     name[TOPIC_NAME_MAX];
+    uint64_t published;
+    struct topic_sub subs[TOPIC_MAX_SUBS];
+};
+
+// Create (or find) a topic, returns its id or -1
+int topic_create(const char* name);
+int topic_find(const char* name);
+
+// Subscribe the current task (one subscription per task and topic)
+int topic_subscribe(int id, uint32_t types, topic_filter_t filter, void* ctx, uint32_t policy);
+int topic_unsubscribe(int id);
+
+// Drop every subscription of an exiting task (publishers blocked on one
+// of its queues move on)
+void topic_task_exit(struct task* t);
+
+// Publish to every matching subscriber. Returns deliveries, -1 on error.
+int topic_publish(int id, uint32_t type, const void* data, uint32_t size);
+
+// Next message for the current task's subscription (blocking, timeout_ms
+// 0 = forever). Read-only shared buffer: pass it to topic_release().
+const struct message* topic_receive(int id, uint64_t timeout_ms);
+void topic_release(const struct message* msg);
+
+#endif // TOPIC_H
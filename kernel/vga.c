@@ -36,15 +36,20 @@
 #include "libc.h"
 #include "serial.h" // For Dual Output (VGA + Serial)
 #include "kernel.h"
+#include "sync.h"
 
 // VGA Memory Buffer Address (Standard Text Mode)
-static volatile uint16_t* vga_buffer = (uint16_t*)0xB8000;
+static volatile uint16_t* vga_buffer = (uint16_t*)(PHYS_MAP_BASE + 0xB8000);
 
 // Cursor Position State
 static int cursor_x = 0;
 static int cursor_y = 0;
 static uint8_t current_color = 0x0F; // White on Black
 
+// Cursor and buffer; interrupt handlers print too, so always irqsave
+static struct spinlock vga_lock;
+static struct lock_stats vga_lock_stats;
+
 /**
  * Compose a VGA entry from character and color
  */
@@ -75,6 +80,7 @@ static void update_cursor(void) {
  * Initialize VGA Driver
  */
 void vga_init(void) {
+    spin_init(&vga_lock, &vga_lock_stats, "vga");
     vga_clear();
 }
 
@@ -82,12 +88,14 @@ void vga_init(void) {
  * Clear the Screen
  */
 void vga_clear(void) {
+    uint64_t flags = spin_lock_irqsave(&vga_lock);
     for (int i = 0; i < VGA_WIDTH * VGA_HEIGHT; i++) {
         vga_buffer[i] = vga_entry(' ', current_color);
     }
     cursor_x = 0;
     cursor_y = 0;
     update_cursor();
+    spin_unlock_irqrestore(&vga_lock, flags);
 }
 
 /**
@@ -125,10 +133,10 @@ void vga_scroll(void) {
 }
 
 /**
- * output a single character to the screen
+ * output a single character to the screen (vga_lock held)
  * Handles special characters like Newline, Tab, Backspace.
  */
-void vga_putc(char c) {
+static void putc_locked(char c) {
     if (c == '\n') {
         cursor_x = 0;
         cursor_y++;
@@ -160,6 +168,12 @@ void vga_putc(char c) {
     update_cursor();
 }
 
+void vga_putc(char c) {
+    uint64_t flags = spin_lock_irqsave(&vga_lock);
+    putc_locked(c);
+    spin_unlock_irqrestore(&vga_lock, flags);
+}
+
 /**
  * Output a String
  * Mirrors output to Serial Port for debugging.
@@ -168,18 +182,13 @@ void vga_puts(const char* str) {
     // 1. Mirror to Serial Port (Headless Debug)
     serial_puts(str);
     
-    // 2. VGA Output
-    // Disable interrupts to ensure atomic printing (no race conditions)
-    uint64_t flags;
-    asm volatile("pushfq; pop %0; cli" : "=r"(flags));
-    
+    // 2. VGA Output, whole string under the lock (lines stay in one piece)
+    uint64_t flags = spin_lock_irqsave(&vga_lock);
     const char* s = str;
     while (*s) {
-        vga_putc(*s++);
+        putc_locked(*s++);
     }
-    
-    // Restore Interrupts if they were enabled
-    if (flags & 0x200) asm volatile("sti");
+    spin_unlock_irqrestore(&vga_lock, flags);
 }
 
 /**
@@ -206,9 +215,11 @@ void vga_putx(uint32_t value) {
  */
 void vga_set_cursor(int x, int y) {
     if (x >= 0 && x < VGA_WIDTH && y >= 0 && y < VGA_HEIGHT) {
+        uint64_t flags = spin_lock_irqsave(&vga_lock);
         cursor_x = x;
         cursor_y = y;
         update_cursor();
+        spin_unlock_irqrestore(&vga_lock, flags);
     }
 }
 
@@ -0,0 +1,512 @@
+/*
+ * vmm.c - Virtual Memory Regions and Demand Paging
+ *
+ * BSD 3-Clause License
+ * Copyright (c) 2025, NeXs Operate System
+ */
+
+#include "vmm.h"
+#include "buddy.h"
+#include "libc.h"
+
+// Stack slots in TASK_STACK_AREA (one bit per slot, MAX_TASKS <= 64)
+static uint64_t stack_slots = 0;
+
+// Zeroed frames for stack faults. Faults only take from it (interrupts off);
+// vmm_stack_refill() puts frames back from normal context.
+static void* stack_reserve[VMM_STACK_RESERVE];
+static int stack_reserve_count = 0;
+
+// Statistics
+static uint64_t fault_count = 0;
+static uint64_t page_count = 0;     // Resident frames, in 4KB units
+static uint64_t cow_count = 0;
+static struct vmm_thp_stats thp;
+
+#define HUGE_MASK   (PAGE_SIZE_2M - 1)
+
+int vmm_reserve(struct task* t, uint64_t start, size_t size, uint64_t flags) {
+    if (!t || (start | size) & (PAGE_SIZE - 1) || size == 0) return -1;
+
+    struct vm_region* r = buddy_alloc(sizeof(struct vm_region));
+    if (!r) return -1;
+
+    r->start = start;
+    r->end = start + size;
+    r->flags = flags;
+    r->next = t->regions;
+    t->regions = r;
+    return 0;
+}
+
+struct vm_region* vmm_find(struct task* t, uint64_t addr) {
+    for (struct vm_region* r = t->regions; r; r = r->next) {
+        if (addr >= r->start && addr < r->end) return r;
+    }
+    return NULL;
+}
+
+// Anonymous (user-half) regions get 2MB pages for blocks they fully cover
+static inline bool vmm_thp_eligible(struct vm_region* r, uint64_t addr) {
+    uint64_t block = addr & ~HUGE_MASK;
+    return r->end <= VMM_USER_TOP && block >= r->start && block + PAGE_SIZE_2M <= r->end;
+}
+
+// 2MB-aligned physical block for a huge page (NULL if none available)
+static void* vmm_alloc_huge(void) {
+    void* page = page_alloc(VMM_HUGE_ORDER);
+    if (page && (virt_to_phys(page) & HUGE_MASK)) {
+        // Buddy blocks are aligned to the heap base, not always physically
+        page_free(page, VMM_HUGE_ORDER);
+        page = NULL;
+    }
+    if (!page) thp.fallbacks++;
+    return page;
+}
+
+// Back the 2MB block around addr with one zeroed huge page
+static int vmm_populate_huge(struct task* t, struct vm_region* r, uint64_t addr) {
+    uint64_t* pml4 = task_space(t);
+    uint64_t block = addr & ~HUGE_MASK;
+    if (!paging_can_map_2m(pml4, block)) return -1;    // 4KB pages already there
+
+    void* page = vmm_alloc_huge();
+    if (!page) return -1;
+    memset(page, 0, PAGE_SIZE_2M);
+
+    if (paging_map_2m(pml4, block, virt_to_phys(page), r->flags) != 0) {
+        page_free(page, VMM_HUGE_ORDER);
+        return -1;
+    }
+    t->pages_2m++;
+    page_count += VMM_HUGE_PAGES;
+    thp.faults++;
+    return 0;
+}
+
+// Back one page of a region with a zeroed frame
+static int vmm_populate(struct task* t, struct vm_region* r, uint64_t addr) {
+    if (vmm_thp_eligible(r, addr) && vmm_populate_huge(t, r, addr) == 0) return 0;
+
+    void* page = page_alloc(0);
+    if (!page) return -1;
+    memset(page, 0, PAGE_SIZE);
+
+    addr &= ~(PAGE_SIZE - 1);
+    if (paging_map(task_space(t), addr, virt_to_phys(page), PAGE_SIZE, r->flags) != 0) {
+        page_free(page, 0);
+        return -1;
+    }
+    t->pages_4k++;
+    page_count++;
+    return 0;
+}
+
+// Unmap a region, free its frames and drop it from the task
+static void vmm_release(struct task* t, struct vm_region* r) {
+    uint64_t* pml4 = task_space(t);
+    for (uint64_t addr = r->start; addr < r->end; addr += PAGE_SIZE) {
+        uint64_t phys, flags;
+        if (!paging_translate(pml4, addr, &phys, &flags)) continue;
+
+        if (flags & PAGE_HUGE) {
+            paging_unmap(pml4, addr, PAGE_SIZE_2M);
+            if (page_ref_put(phys_to_virt(phys), VMM_HUGE_ORDER) == 0) page_count -= VMM_HUGE_PAGES;
+            t->pages_2m--;
+            addr += PAGE_SIZE_2M - PAGE_SIZE;
+            continue;
+        }
+
+        paging_unmap(pml4, addr, PAGE_SIZE);
+        if (page_ref_put(phys_to_virt(phys), 0) == 0) page_count--;
+        t->pages_4k--;
+    }
+
+    struct vm_region** pp = &t->regions;
+    while (*pp && *pp != r) pp = &(*pp)->next;
+    if (*pp) *pp = r->next;
+    buddy_free(r);
+}
+
+void vmm_stack_refill(void) {
+    while (stack_reserve_count < VMM_STACK_RESERVE) {
+        void* page = page_alloc(0);
+        if (!page) return;
+        memset(page, 0, PAGE_SIZE);
+
+        uint64_t irq = irq_save();
+        bool kept = stack_reserve_count < VMM_STACK_RESERVE;
+        if (kept) stack_reserve[stack_reserve_count++] = page;
+        irq_restore(irq);
+        if (!kept) page_free(page, 0);
+    }
+}
+
+uint64_t vmm_stack_create(struct task* t) {
+    int slot = 0;
+    while (slot < MAX_TASKS && (stack_slots & (1ULL << slot))) slot++;
+    if (slot == MAX_TASKS) return 0;
+
+    // [guard page][TASK_STACK_SIZE stack]
+    uint64_t bottom = TASK_STACK_AREA + slot * TASK_STACK_STRIDE + PAGE_SIZE;
+    uint64_t top = bottom + TASK_STACK_SIZE;
+
+    // Page tables for the whole slot now (shared kernel half, never freed),
+    // so a later stack fault only has to fill in a PTE
+    if (paging_prepare(task_space(t), bottom, TASK_STACK_SIZE) != 0) return 0;
+    if (vmm_reserve(t, bottom, TASK_STACK_SIZE, PAGE_KERNEL_RW | PAGE_NX) != 0) return 0;
+
+    struct vm_region* r = t->regions;
+    for (uint64_t addr = top - TASK_STACK_EAGER * PAGE_SIZE; addr < top; addr += PAGE_SIZE) {
+        if (vmm_populate(t, r, addr) != 0) {
+            vmm_release(t, r);
+            return 0;
+        }
+    }
+    vmm_stack_refill();
+
+    stack_slots |= 1ULL << slot;
+    t->stack_base = (void*)bottom;
+    return top;
+}
+
+// Free user-half address above the highest region (0 if none)
+static uint64_t vmm_place(struct task* t, size_t size) {
+    uint64_t addr = VMM_ANON_BASE;
+    for (struct vm_region* r = t->regions; r; r = r->next) {
+        if (r->end <= VMM_USER_TOP && r->end > addr) addr = r->end;
+    }
+    if (size >= PAGE_SIZE_2M) addr = (addr + HUGE_MASK) & ~HUGE_MASK;
+    if (addr + size > VMM_USER_TOP) return 0;
+    return addr;
+}
+
+uint64_t vmm_map_anon(struct task* t, size_t size, uint64_t flags) {
+    size = (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+
+    uint64_t addr = vmm_place(t, size);
+    if (!addr) return 0;
+    return vmm_reserve(t, addr, size, flags) == 0 ? addr : 0;
+}
+
+uint64_t vmm_map_shared(struct task* t, void** frames, uint32_t count, uint64_t flags) {
+    size_t size = (size_t)count * PAGE_SIZE;
+    flags |= PAGE_SHARED;
+
+    uint64_t addr = vmm_place(t, size);
+    if (!addr || vmm_reserve(t, addr, size, flags) != 0) return 0;
+
+    // Fully mapped up front: no faults, so never backed by huge pages
+    uint64_t* pml4 = task_space(t);
+    for (uint32_t i = 0; i < count; i++) {
+        if (paging_map(pml4, addr + i * PAGE_SIZE, virt_to_phys(frames[i]), PAGE_SIZE, flags) != 0) {
+            vmm_unmap(t, addr);
+            return 0;
+        }
+        page_ref_get(frames[i]);
+        t->pages_4k++;
+    }
+    return addr;
+}
+
+int vmm_unmap(struct task* t, uint64_t start) {
+    for (struct vm_region* r = t->regions; r; r = r->next) {
+        if (r->start == start) {
+            vmm_release(t, r);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int vmm_clone(struct task* parent, struct task* child) {
+    uint64_t* src = task_space(parent);
+    uint64_t* dst = task_space(child);
+
+    for (struct vm_region* r = parent->regions; r; r = r->next) {
+        if (r->start >= VMM_USER_TOP) continue;     // Stacks are per task
+        if (vmm_reserve(child, r->start, r->end - r->start, r->flags) != 0) return -1;
+
+        for (uint64_t addr = r->start; addr < r->end; addr += PAGE_SIZE) {
+            uint64_t phys, flags;
+            if (!paging_translate(src, addr, &phys, &flags)) continue;
+
+            bool huge = flags & PAGE_HUGE;
+            uint64_t size = huge ? PAGE_SIZE_2M : PAGE_SIZE;
+            flags &= ~PAGE_HUGE;
+
+            // Writable private pages become read-only in both spaces until written
+            if (!(flags & PAGE_SHARED) && (flags & (PAGE_WRITABLE | PAGE_COW))) {
+                flags = (flags & ~PAGE_WRITABLE) | PAGE_COW;
+                paging_protect(src, addr, size, flags);
+            }
+
+            int rc = huge ? paging_map_2m(dst, addr, phys, flags)
+                          : paging_map(dst, addr, phys, PAGE_SIZE, flags);
+            if (rc != 0) return -1;
+            page_ref_get(phys_to_virt(phys));
+
+            if (huge) {
+                child->pages_2m++;
+                addr += PAGE_SIZE_2M - PAGE_SIZE;
+            } else {
+                child->pages_4k++;
+            }
+        }
+    }
+    return 0;
+}
+
+void vmm_destroy(struct task* t) {
+    if (t->stack_base) {
+        uint64_t slot = ((uint64_t)t->stack_base - TASK_STACK_AREA) / TASK_STACK_STRIDE;
+        stack_slots &= ~(1ULL << slot);
+        t->stack_base = NULL;
+    }
+    while (t->regions) vmm_release(t, t->regions);
+}
+
+// Write to a shared 2MB page: copy it whole, or as 4KB pages if no huge
+// block is free (the faulting task then owns 512 private small pages)
+static int vmm_cow_break_huge(struct task* t, struct vm_region* r, uint64_t block, void* old) {
+    uint64_t* pml4 = task_space(t);
+
+    void* page = vmm_alloc_huge();
+    if (page) {
+        memcpy(page, old, PAGE_SIZE_2M);
+        if (paging_map_2m(pml4, block, virt_to_phys(page), r->flags) != 0) {
+            page_free(page, VMM_HUGE_ORDER);
+            return -1;
+        }
+        page_count += VMM_HUGE_PAGES;
+    } else {
+        paging_unmap(pml4, block, PAGE_SIZE_2M);
+        for (uint64_t off = 0; off < PAGE_SIZE_2M; off += PAGE_SIZE) {
+            void* small = page_alloc(0);
+            if (!small) return -1;
+            memcpy(small, (uint8_t*)old + off, PAGE_SIZE);
+            if (paging_map(pml4, block + off, virt_to_phys(small), PAGE_SIZE, r->flags) != 0) {
+                page_free(small, 0);
+                return -1;
+            }
+            t->pages_4k++;
+            page_count++;
+        }
+        t->pages_2m--;
+    }
+
+    if (page_ref_put(old, VMM_HUGE_ORDER) == 0) page_count -= VMM_HUGE_PAGES;
+    return 0;
+}
+
+// Write to a shared page: copy it, or reclaim it if we are the last owner
+static int vmm_cow_break(struct task* t, struct vm_region* r, uint64_t addr) {
+    uint64_t* pml4 = task_space(t);
+    uint64_t phys, flags;
+
+    if (!paging_translate(pml4, addr, &phys, &flags) || !(flags & PAGE_COW)) return -1;
+    if (!(r->flags & PAGE_WRITABLE)) return -1;
+
+    cow_count++;
+    uint64_t size = (flags & PAGE_HUGE) ? PAGE_SIZE_2M : PAGE_SIZE;
+    addr &= ~(size - 1);
+    phys &= ~(size - 1);
+
+    void* old = phys_to_virt(phys);
+    if (page_ref_count(old) == 1) {
+        return paging_protect(pml4, addr, size, r->flags);
+    }
+    if (size == PAGE_SIZE_2M) return vmm_cow_break_huge(t, r, addr, old);
+
+    void* page = page_alloc(0);
+    if (!page) return -1;
+    memcpy(page, old, PAGE_SIZE);
+
+    if (paging_map(pml4, addr, virt_to_phys(page), PAGE_SIZE, r->flags) != 0) {
+        page_free(page, 0);
+        return -1;
+    }
+    if (page_ref_put(old, 0) > 0) page_count++;
+    return 0;
+}
+
+// Touch below the eager part of a task stack: map a frame from the reserve.
+// The faulting code may hold buddy_lock, so no allocation here.
+static bool vmm_stack_fault(struct task* t, uint64_t addr) {
+    struct vm_region* r = vmm_find(t, addr);
+    if (!r || stack_reserve_count == 0) return false;
+
+    void* page = stack_reserve[--stack_reserve_count];
+    addr &= ~(PAGE_SIZE - 1);
+    if (paging_map(task_space(t), addr, virt_to_phys(page), PAGE_SIZE, r->flags) != 0) {
+        stack_reserve[stack_reserve_count++] = page;
+        return false;
+    }
+    t->pages_4k++;
+    page_count++;
+    return true;
+}
+
+bool vmm_handle_fault(uint64_t addr, uint64_t err_code) {
+    fault_count++;
+    if (!current_task) return false;
+    if (addr >= VMM_USER_TOP) {
+        // Kernel half: only task stacks are demand paged
+        if (addr < TASK_STACK_AREA || (err_code & PF_PRESENT)) return false;
+        return vmm_stack_fault(current_task, addr);
+    }
+
+    struct vm_region* r = vmm_find(current_task, addr);
+    if (!r) return false;
+
+    // Not present: demand fault. Present + write: copy-on-write break.
+    if (!(err_code & PF_PRESENT)) return vmm_populate(current_task, r, addr) == 0;
+    if (err_code & PF_WRITE) return vmm_cow_break(current_task, r, addr) == 0;
+    return false;
+}
+
+// =============================================================================
+// Huge Page Collapser
+// =============================================================================
+
+// True if t (PID pid) has not been reaped and r is still one of its
+// regions (vmm_unmap may have freed it). Interrupts disabled.
+static bool vmm_region_live(struct task* t, uint32_t pid, struct vm_region* r, uint64_t start) {
+    if (task_find(pid) != t || t->state == TASK_TERMINATED) return false;
+    for (struct vm_region* p = t->regions; p; p = p->next) {
+        if (p == r) return p->start == start;
+    }
+    return false;
+}
+
+// Every page of the run present and private. First pass (again = false)
+// records the frames; the second checks they are unchanged and still
+// write-protected by us.
+static bool vmm_collapse_check(uint64_t* pml4, uint64_t block, uint64_t* old, bool again) {
+    for (int i = 0; i < VMM_HUGE_PAGES; i++) {
+        uint64_t phys, flags;
+        if (!paging_translate(pml4, block + i * PAGE_SIZE, &phys, &flags)) return false;
+        if (again) {
+            if (phys != old[i] || !(flags & PAGE_COW)) return false;
+        } else {
+            if (flags & PAGE_COW) return false;
+            old[i] = phys;
+        }
+        if (page_ref_count(phys_to_virt(phys)) != 1) return false;
+    }
+    return true;
+}
+
+// Frames of the run being collapsed (one scan at a time)
+static uint64_t collapse_old[VMM_HUGE_PAGES];
+static bool collapse_busy = false;
+
+// Merge a fully populated, private run of 512 small pages into one 2MB page.
+// Called with interrupts disabled; the 2MB copy runs with the caller's
+// interrupt state 'irq'. The run is write-protected as COW first, so a
+// write by the owner meanwhile faults, reclaims its page (refcount 1) and
+// makes the recheck fail. The owner may even exit and be reaped: t is
+// only touched again once vmm_region_live() has vouched for it.
+static bool vmm_collapse_block(struct task* t, struct vm_region* r, uint64_t block, uint64_t irq) {
+    uint64_t* pml4 = task_space(t);
+    uint32_t pid = t->pid;
+    uint64_t start = r->start;
+    uint64_t flags = r->flags;
+    uint64_t* old = collapse_old;
+
+    bool ok = !paging_can_map_2m(pml4, block)          // Empty or already huge
+           && vmm_collapse_check(pml4, block, old, false)
+           && paging_protect(pml4, block, PAGE_SIZE_2M, (flags & ~PAGE_WRITABLE) | PAGE_COW) == 0;
+    if (!ok) return false;
+
+    irq_restore(irq);
+    void* huge = vmm_alloc_huge();
+    if (huge) {
+        for (int i = 0; i < VMM_HUGE_PAGES; i++) {
+            memcpy((uint8_t*)huge + i * PAGE_SIZE, phys_to_virt(old[i]), PAGE_SIZE);
+        }
+    }
+    irq_save();
+
+    bool live = vmm_region_live(t, pid, r, start);
+    ok = huge && live
+       && vmm_collapse_check(pml4, block, old, true)
+       && paging_collapse(pml4, block, virt_to_phys(huge), flags) == 0;
+    if (!ok && live) {
+        // Lift our protection from pages nobody has touched or shared since
+        for (int i = 0; i < VMM_HUGE_PAGES; i++) {
+            uint64_t phys, pf;
+            if (!paging_translate(pml4, block + i * PAGE_SIZE, &phys, &pf)) continue;
+            if (phys != old[i] || !(pf & PAGE_COW) || (pf & PAGE_HUGE)) continue;
+            if (page_ref_count(phys_to_virt(phys)) != 1) continue;
+            paging_protect(pml4, block + i * PAGE_SIZE, PAGE_SIZE, flags);
+        }
+    }
+
+    if (!ok) {
+        if (huge) page_free(huge, VMM_HUGE_ORDER);
+        return false;
+    }
+    for (int i = 0; i < VMM_HUGE_PAGES; i++) {
+        page_free(phys_to_virt(old[i]), 0);
+    }
+    t->pages_4k -= VMM_HUGE_PAGES;
+    t->pages_2m++;
+    thp.collapses++;
+    return true;
+}
+
+// The task list and regions are walked with interrupts disabled; they
+// are only enabled for each block's copy, after which the task and the
+// region are looked up again before going on.
+int vmm_collapse_scan(void) {
+    int merged = 0;
+    uint64_t irq = irq_save();
+    struct task* start = current_task;     // The scanning task itself
+    if (!start || collapse_busy) {
+        irq_restore(irq);
+        return 0;
+    }
+    collapse_busy = true;
+
+    struct task* t = start;
+    do {
+        uint32_t pid = t->pid;
+        if (t->state != TASK_TERMINATED) {
+            for (struct vm_region* r = t->regions; r; r = r->next) {
+                if (r->end > VMM_USER_TOP) continue;
+                uint64_t base = r->start, end = r->end;
+                uint64_t block = (base + HUGE_MASK) & ~HUGE_MASK;
+                for (; block + PAGE_SIZE_2M <= end; block += PAGE_SIZE_2M) {
+                    merged += vmm_collapse_block(t, r, block, irq);
+                    if (!vmm_region_live(t, pid, r, base)) break;
+                }
+                if (!vmm_region_live(t, pid, r, base)) break;   // r->next is stale
+            }
+        }
+        if (task_find(pid) != t) break;     // Reaped meanwhile: t->next is stale
+        t = t->next;
+    } while (t != start);
+
+    thp.scans++;
+    collapse_busy = false;
+    irq_restore(irq);
+    return merged;
+}
+
+void vmm_collapse_daemon(void) {
+    while (1) {
+        sleep(VMM_COLLAPSE_INTERVAL);
+        vmm_collapse_scan();
+    }
+}
+
+void vmm_stats(uint64_t* faults, uint64_t* pages, uint64_t* cow_breaks) {
+    if (faults) *faults = fault_count;
+    if (pages) *pages = page_count;
+    if (cow_breaks) *cow_breaks = cow_count;
+}
+
+void vmm_thp_stats(struct vmm_thp_stats* out) {
+    if (out) *out = thp;
+}
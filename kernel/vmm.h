@@ -0,0 +1,112 @@
+/*
+ * vmm.h - Virtual Memory Regions and Demand Paging
+ *
+ * BSD 3-Clause License
+ * Copyright (c) 2025, NeXs Operate System
+ *
+ * A task owns a list of reserved regions. Pages inside a user-half region
+ * are allocated by the page fault handler on first touch; task stacks map
+ * their top pages up front and fault the rest in from a reserve, and
+ * addresses outside every region (e.g. stack guard pages) are real faults.
+ */
+
+#ifndef VMM_H
+#define VMM_H
+
+#include "kernel.h"
+#include "paging.h"
+#include "process.h"
+
+// Task Stacks: one slot per task in TASK_STACK_AREA, guard page at the bottom.
+// The top TASK_STACK_EAGER pages are mapped at creation. Deeper pages fault
+// in from a reserve of zeroed frames: the fault can hit while the task holds
+// the allocator or scheduler locks, so it never calls page_alloc().
+#define TASK_STACK_SIZE     0x10000ULL      // 64KB per task
+#define TASK_STACK_EAGER    2               // Pages mapped at creation
+#define VMM_STACK_RESERVE   32              // Frames kept for stack faults
+#define TASK_STACK_STRIDE   (TASK_STACK_SIZE + PAGE_SIZE)
+
+// Anonymous Memory: user half, above the first 1GB
+#define VMM_ANON_BASE       0x40000000ULL
+#define VMM_USER_TOP        0x0000800000000000ULL
+
+// Transparent Huge Pages
+#define VMM_HUGE_ORDER      9               // 2MB = 2^9 pages
+#define VMM_HUGE_PAGES      (1 << VMM_HUGE_ORDER)
+#define VMM_COLLAPSE_INTERVAL 1000          // Collapser period (ms)
+
+struct vmm_thp_stats {
+    uint64_t faults;        // 2MB pages allocated at fault time
+    uint64_t fallbacks;     // No aligned 2MB block free, used 4KB pages
+    uint64_t collapses;     // 4KB runs merged by the collapser
+    uint64_t scans;
+};
+
+// Page Fault Error Code
+#define PF_PRESENT          (1 << 0)        // Protection violation (page present)
+#define PF_WRITE            (1 << 1)
+#define PF_USER             (1 << 2)
+#define PF_FETCH            (1 << 4)
+
+// Reserved region [start, end), backed on demand with 'flags'
+struct vm_region {
+    uint64_t start;
+    uint64_t end;
+    uint64_t flags;
+    struct vm_region* next;
+};
+
+// True if addr lies in the guard page below a task stack
+static inline bool vmm_stack_guard(uint64_t addr) {
+    if (addr < TASK_STACK_AREA || addr >= TASK_STACK_AREA + MAX_TASKS * TASK_STACK_STRIDE) return false;
+    return (addr - TASK_STACK_AREA) % TASK_STACK_STRIDE < PAGE_SIZE;
+}
+
+// Page tables of a task
+static inline uint64_t* task_space(struct task* t) {
+    return phys_to_virt(t->cr3 & PAGE_ADDR_MASK);
+}
+
+// Reserve a demand-paged region for a task
+int vmm_reserve(struct task* t, uint64_t start, size_t size, uint64_t flags);
+
+// Find region containing addr (NULL if none)
+struct vm_region* vmm_find(struct task* t, uint64_t addr);
+
+// Reserve a stack slot for a task, returns stack top (0 on failure)
+uint64_t vmm_stack_create(struct task* t);
+
+// Top up the stack fault reserve (normal context, may allocate)
+void vmm_stack_refill(void);
+
+// Reserve an anonymous user-half region (2MB aligned if >= 2MB), returns address
+uint64_t vmm_map_anon(struct task* t, size_t size, uint64_t flags);
+
+// Map existing frames (one 4KB page each) into a new user-half region,
+// taking a reference on each. Writes stay visible to every space that
+// maps them: PAGE_SHARED regions are never made copy-on-write.
+uint64_t vmm_map_shared(struct task* t, void** frames, uint32_t count, uint64_t flags);
+
+// Release the region starting at 'start' and its pages
+int vmm_unmap(struct task* t, uint64_t start);
+
+// Share parent's user-half regions with child, copy on write
+int vmm_clone(struct task* parent, struct task* child);
+
+// Release all regions and the stack slot of a task
+void vmm_destroy(struct task* t);
+
+// Page fault entry: returns true if the fault was resolved
+bool vmm_handle_fault(uint64_t addr, uint64_t err_code);
+
+// Merge fully populated 4KB runs of anonymous regions into 2MB pages
+int vmm_collapse_scan(void);
+
+// Background task running vmm_collapse_scan() periodically
+void vmm_collapse_daemon(void);
+
+// Statistics
+void vmm_stats(uint64_t* faults, uint64_t* pages, uint64_t* cow_breaks);
+void vmm_thp_stats(struct vmm_thp_stats* out);
+
+#endif // VMM_H